@@ -201,8 +201,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read);
+			/* Read as many full sectors as possible directly into caller's
+			 * buffer with a single disk command, as the sectors of an inode
+			 * are contiguous. */
+			off_t full_left = size < inode_left ? size : inode_left;
+			size_t sector_cnt = full_left / DISK_SECTOR_SIZE;
+			if (sector_cnt > DISK_MULTIPLE_MAX)
+				sector_cnt = DISK_MULTIPLE_MAX;
+			chunk_size = sector_cnt * DISK_SECTOR_SIZE;
+			disk_read_multiple (filesys_disk, sector_idx, buffer + bytes_read,
+					sector_cnt);
 		} else {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
@@ -256,8 +264,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written);
+			/* Write as many full sectors as possible directly from caller's
+			 * buffer with a single disk command, as the sectors of an inode
+			 * are contiguous. */
+			off_t full_left = size < inode_left ? size : inode_left;
+			size_t sector_cnt = full_left / DISK_SECTOR_SIZE;
+			if (sector_cnt > DISK_MULTIPLE_MAX)
+				sector_cnt = DISK_MULTIPLE_MAX;
+			chunk_size = sector_cnt * DISK_SECTOR_SIZE;
+			disk_write_multiple (filesys_disk, sector_idx, buffer + bytes_written,
+					sector_cnt);
 		} else {
 			/* We need a bounce buffer. */
 			if (bounce == NULL) {
@@ -32,6 +32,19 @@ enum {
 
 	/* Extra for Project 2 */
 	SYS_DUP2,                   /* Duplicate the file descriptor */
+
+	/* Extra for Project 3 */
+	SYS_MADVISE,                /* Advise on the use of a memory range. */
+	SYS_MLOCK,                  /* Lock a memory range in the main memory. */
+	SYS_MUNLOCK,                /* Unlock a memory range. */
+	SYS_MSYNC,                  /* Write back a memory mapped range. */
 };
 
+/* Advice values of madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random accesses: no read-ahead. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential accesses: more read-ahead. */
+#define MADV_WILLNEED 3         /* Expect accesses soon: load now. */
+#define MADV_DONTNEED 4         /* Expect no accesses soon: page out now. */
+
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,31 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* x87, MMX and SSE registers of a thread, in the layout of the
+   FXSAVE and FXRSTOR instructions.  See [IA32-v1] 10.5
+   "FXSAVE and FXRSTOR Instructions". */
+struct fpu_state {
+	uint8_t regs[512];
+} __attribute__ ((aligned (16)));
+
+void fpu_init (void);
+void fpu_switch (struct thread *next);
+bool fpu_copy (struct thread *dst, struct thread *src);
+void fpu_release (struct thread *);
+void fpu_print_stats (void);
+
+/* Use of the SSE registers by the kernel. */
+void kernel_fpu_begin (void);
+void kernel_fpu_end (void);
+
+/* SSE2 page kernels. */
+void fpu_page_copy (void *dst, const void *src);
+void fpu_page_zero (void *dst);
+bool fpu_page_equal (const void *a, const void *b);
+
+#endif /* threads/fpu.h */
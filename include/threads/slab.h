@@ -0,0 +1,39 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Constructor of the objects of a cache. */
+typedef void slab_ctor_func (void *obj);
+
+/* Cache of objects of a single size, carved from pages ("slabs"). */
+struct slab_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Size of each object in bytes. */
+	size_t objs_ofs;            /* Offset of the first object of a slab. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	slab_ctor_func *ctor;       /* Run on each object allocated, or null. */
+	struct list partial;        /* Slabs with free objects. */
+	struct lock lock;           /* Lock. */
+	struct list_elem elem;      /* Element in the list of all caches. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs held, empty ones included. */
+	size_t empty_cnt;           /* Slabs held with no object in use. */
+	size_t in_use;              /* Objects in use. */
+	size_t peak;                /* Highest IN_USE so far. */
+	long long alloc_cnt;        /* Objects allocated. */
+	long long free_cnt;         /* Objects freed. */
+	long long grow_cnt;         /* Slabs obtained from the page allocator. */
+};
+
+void slab_init (void);
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+		size_t align, slab_ctor_func *ctor);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
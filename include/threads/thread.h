@@ -170,8 +170,21 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	/* Owned by vm/vm.c, under the frame table lock. */
+	size_t rss;													/* Number of frames held by the pages
+																				 of SPT (resident set size). */
+	size_t ws_size;											/* Pages found accessed by the working
+																				 set sampler on round WS_ROUND - 1. */
+	size_t ws_next;											/* Pages found accessed so far on
+																				 round WS_ROUND. */
+	unsigned ws_round;									/* Last sampling round that found any
+																				 page accessed. */
 #endif
 
+	/* Owned by threads/fpu.c. */
+	struct fpu_state *fpu;              /* Saved FPU registers, or null if
+																				 the FPU was never used. */
+
 	/* Owned by thread.c. */
 	struct intr_frame tf;               /* Information for switching */
 	unsigned magic;                     /* Detects stack overflow. */
@@ -20,6 +20,11 @@
 #define PGSIZE  (1 << PGBITS)              /* Bytes in a page. */
 #define PGMASK  BITMASK(PGSHIFT, PGBITS)   /* Page offset bits (0:12). */
 
+/* Large page (2 MiB), mapped by a single page directory entry. */
+#define LPGBITS 21                         /* Number of offset bits. */
+#define LPGSIZE (1 << LPGBITS)             /* Bytes in a large page. */
+#define LPGMASK BITMASK(PGSHIFT, LPGBITS)  /* Large page offset bits (0:21). */
+
 /* Offset within a page. */
 #define pg_ofs(va) ((uint64_t) (va) & PGMASK)
 
@@ -31,6 +36,9 @@
 /* Round down to nearest page boundary. */
 #define pg_round_down(va) (void *) ((uint64_t) (va) & ~PGMASK)
 
+/* Round down to nearest large page boundary. */
+#define lpg_round_down(va) (void *) ((uint64_t) (va) & ~LPGMASK)
+
 /* Kernel virtual address start */
 #define KERN_BASE LOADER_KERN_BASE
 
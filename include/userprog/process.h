@@ -21,6 +21,19 @@ struct parent_process_frame {
   struct intr_frame *f;
 };
 
+#ifdef VM
+#include "filesys/off_t.h"
+
+/* Structure used in lazy_load_segment and load_segment in order to fetch the
+   executable's data. It is the aux of the uninit pages of type
+   VM_ANON | VM_ANON_EXEC. */
+struct load_segment_aux {
+  struct file *file;  /* Source file (executable) for segment loading. */
+  off_t offset;       /* File's offset to read from. */
+  size_t read_bytes;  /* Number of bytes to read from FILE. */
+};
+#endif
+
 tid_t process_create_initd (const char *command);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *command_);
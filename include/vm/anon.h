@@ -1,24 +1,39 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "filesys/off_t.h"
+#include <stdint.h>
 struct page;
 enum vm_type;
 
+/* Swap slot index of an anonymous page that holds no slot. */
+#define SWAP_NONE SIZE_MAX
+
 /* Types of anon_pages. */
 enum anon_type {
   ANON_STACK,   /* The page belongs to a stack. */
   ANON_EXEC,    /* The page corresponds to executable code. */
+  ANON_PLAIN,   /* Any other page, of type VM_ANON with no subtype. */
 };
 
 struct anon_page {
   struct page *page;          /* Pointer to the owner page. */
-  struct hash_elem swap_elem; /* Element used in the swap table to keep track of
-                               * the page's swap slot. */
-  size_t idx;                 /* Index of the swap slot. */
+  size_t idx;                 /* Index of the swap slot held by the page, or
+                               * SWAP_NONE if none. */
   enum anon_type a_type;
+  bool exec_clean;            /* ANON_EXEC: True if the contents still match the
+                               * executable's, so that they are read from it
+                               * again instead of being swapped. */
+  off_t exec_ofs;             /* ANON_EXEC: Offset in the executable. */
+  size_t exec_bytes;          /* ANON_EXEC: Bytes read from the executable,
+                               * the rest of the page is zeroed. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share (struct page *dst, struct page *src);
+void anon_share_frame (struct page *page);
+bool anon_writeback (struct page *page);
+void anon_exec_loaded (struct page *page, off_t ofs, size_t read_bytes);
 
 #endif
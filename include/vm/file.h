@@ -16,6 +16,9 @@ struct file_page {
 
 void vm_file_init (void);
 bool file_map_initializer (struct page *page, enum vm_type type, void *kva);
+bool file_map_copy (struct page *parent, struct file *file);
+bool file_map_writeback (struct page *page);
+void file_map_writeback_run (struct page *run[], size_t cnt, uint8_t *buf);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
@@ -0,0 +1,32 @@
+#ifndef VM_RADIX_H
+#define VM_RADIX_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Radix tree mapping virtual page numbers to pointers.
+ * It has the shape of the x86-64 page tables: 4 levels of 512 entries, each
+ * level indexed by 9 bits of the page number, so that a lookup takes 4 memory
+ * accesses whatever the number of entries, and iterating over it visits the
+ * entries in address order. */
+
+#define RADIX_BITS 9                          /* Key bits per level. */
+#define RADIX_LEVELS 4                        /* Number of levels. */
+#define RADIX_KEYS (1ULL << (RADIX_BITS * RADIX_LEVELS))  /* Keys < this. */
+
+struct radix {
+	void *root;           /* Top level node, NULL if empty. */
+	size_t cnt;           /* Number of entries. */
+};
+
+typedef void radix_action_func (void *value, void *aux);
+
+void radix_init (struct radix *tree);
+void radix_destroy (struct radix *tree, radix_action_func *action, void *aux);
+bool radix_insert (struct radix *tree, uint64_t key, void *value);
+void *radix_remove (struct radix *tree, uint64_t key);
+void *radix_lookup (const struct radix *tree, uint64_t key);
+void *radix_next (const struct radix *tree, uint64_t *key);
+size_t radix_size (const struct radix *tree);
+
+#endif  /* VM_RADIX_H */
@@ -2,6 +2,7 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include <hash.h>
 
 enum vm_type {
@@ -13,6 +14,8 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* 2 MiB page of an area, mapped by a single page directory entry */
+	VM_LARGE = 4,
 
 	/* Bit flags to store state */
 
@@ -27,6 +30,9 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
+#include "vm/radix.h"
+#include "vm/zswap.h"
 
 struct page_operations;
 struct thread;
@@ -42,8 +48,9 @@ struct page {
 	const struct page_operations *operations;
 	void *va;              /* Address in terms of user space */
 	struct frame *frame;   /* Back reference for frame. */
-	struct hash_elem h_elem; /* Element in the supplemental page table. */
+	struct list_elem f_elem; /* Element in the frame's list of pages. */
 	bool writable;					/* False: Read-only page. True otherwise. */
+	bool locked;						/* True if locked in the main memory (mlock()). */
 	struct thread *t;				/* Owner thread. */
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -57,10 +64,33 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one of these for each page of the user pool, kept in the global
+ * frame table (see vm.c), so frames are never allocated nor freed by
+ * themselves.
+ * A frame may be shared by several pages (i.e. after a fork), in which case
+ * all of them are mapped read-only until they are written (copy-on-write). */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;     /* Page held by the frame, NULL if it is free. If
+												  * the frame is shared, any of the pages in PAGES. */
+	struct list pages;     /* Pages sharing the frame. */
+	size_t ref_cnt;        /* Number of pages in PAGES. */
+	bool pinned;           /* True if the frame must not be evicted. */
+	bool io;               /* True while its pages are written out with the
+	                        * frame table lock released (see vm_io_begin()). */
+	bool zeroed;           /* True if the frame is known to hold only zeros,
+	                        * so that loading a page needs not zero it. */
+	bool referenced;       /* True if the working set sampler found any page
+	                        * accessed since the clock last checked. */
+	uint32_t ksm_sum;      /* Checksum of the contents when last scanned for
+	                        * same-page merging. */
+	/* Text frames, holding read-only pages of an executable, are found by
+	 * their contents, so that the processes running it share them. */
+	struct hash_elem t_elem;  /* Element in the frame table's text table. */
+	struct inode *t_inode; /* Executable's inode, NULL if not a text frame. */
+	off_t t_ofs;           /* Offset of the contents in the executable. */
+	size_t t_bytes;        /* Bytes read from the executable, rest zeroed. */
 };
 
 /* The function table for page operations.
@@ -81,7 +111,15 @@ struct page_operations {
 
 /* Representation of current process's memory space. */
 struct supplemental_page_table {
-	struct hash table;
+	struct radix pages;    /* Pages by page number. */
+	struct vma_tree vmas;  /* Areas whose pages are created on access. */
+	void *ra_next;         /* Page expected to fault next on sequential access. */
+	size_t ra_window;      /* Pages swapped in per fault, read-ahead included. */
+	/* File contents read ahead for the pages being loaded by a fault. */
+	struct file *fa_file;  /* File read, NULL if none. */
+	off_t fa_ofs;          /* Offset in FA_FILE of FA_BUF's first byte. */
+	size_t fa_len;         /* Number of bytes in FA_BUF. */
+	uint8_t *fa_buf;       /* Contents read. */
 };
 
 bool vm_is_page_addr (void *va);
@@ -93,10 +131,29 @@ bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 void supplemental_page_table_kill (struct supplemental_page_table *spt, bool exit);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
+struct page *spt_lookup_page (struct supplemental_page_table *spt,
+		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+extern size_t vm_writeback_low;
+extern size_t vm_writeback_high;
+extern size_t vm_fault_around;
+extern size_t vm_large_max;
+extern long long vm_zero_hits;
+extern long long vm_zero_misses;
+extern size_t vm_ksm_pages;
+extern size_t vm_ksm_sleep;
+extern long long vm_ksm_merged;
+extern long long vm_text_shared;
+extern size_t vm_rss_limit;
+extern size_t vm_ws_sleep;
+extern struct slab_cache vm_vma_slab;
+extern struct slab_cache vm_file_aux_slab;
+extern struct slab_cache vm_seg_aux_slab;
+
 void vm_init (void);
+bool vm_zero_idle (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -104,8 +161,19 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
+bool vm_alloc_area (enum vm_type type, void *start, size_t page_cnt,
+		bool writable, vm_initializer *init, struct file *file, off_t ofs,
+		size_t read_bytes);
 void vm_dealloc_page (struct page *page);
+void vm_release_frame (struct page *page);
 bool vm_claim_page (void *va, struct supplemental_page_table *spt);
+off_t vm_file_read (struct file *file, void *kva, size_t length, off_t ofs);
+bool vm_range_is_mapped (struct supplemental_page_table *spt, void *start,
+		void *end);
+bool vm_madvise (void *start, void *end, int advice);
+bool vm_mlock (void *start, void *end, bool lock);
+void vm_writeback_area (struct supplemental_page_table *spt, void *start,
+		void *end);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
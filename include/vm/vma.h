@@ -0,0 +1,52 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/uninit.h"
+
+struct file;
+enum vm_type;
+
+/* A virtual memory area: a range of pages of an address space that share
+ * their type and content source, such as a mapped file or an executable
+ * segment. The pages of an area are only created when first accessed (see
+ * spt_find_page()), so mapping a large area costs the same as a small one. */
+struct vma {
+	void *start;              /* First page of the area. */
+	void *end;                /* One past the last page of the area. */
+	enum vm_type type;        /* Type of the pages, VM_FILE or VM_ANON with
+	                           * VM_ANON_EXEC. */
+	bool writable;
+	struct file *file;        /* Mapped file, owned by the area. NULL for
+	                           * executable segments, which are read from the
+	                           * owner's executable. */
+	off_t offset;             /* Offset in FILE of START. */
+	size_t read_bytes;        /* Bytes read from FILE, the rest is zeroed. */
+	vm_initializer *init;     /* Initializer of the pages. */
+	int advice;               /* Access pattern advised by madvise(). */
+
+	/* AVL tree links, keyed by START. */
+	struct vma *left;
+	struct vma *right;
+	int height;
+};
+
+/* The areas of an address space, which never overlap. */
+struct vma_tree {
+	struct vma *root;
+	size_t cnt;               /* Number of areas. */
+};
+
+typedef void vma_action_func (struct vma *vma);
+
+void vma_tree_init (struct vma_tree *tree);
+void vma_tree_destroy (struct vma_tree *tree, vma_action_func *destructor);
+bool vma_insert (struct vma_tree *tree, struct vma *vma);
+void vma_remove (struct vma_tree *tree, struct vma *vma);
+struct vma *vma_find (const struct vma_tree *tree, const void *va);
+struct vma *vma_find_next (const struct vma_tree *tree, const void *va);
+bool vma_overlaps (const struct vma_tree *tree, const void *start,
+		const void *end);
+
+#endif  /* VM_VMA_H */
@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache, in front of the swap disk. */
+
+extern size_t vm_zswap_max;
+
+void zswap_init (size_t slot_cnt);
+bool zswap_store (size_t idx, const void *kva);
+bool zswap_load (size_t idx, void *kva);
+void zswap_invalidate (size_t idx);
+void zswap_print_stats (void);
+
+#endif
@@ -63,6 +63,57 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type where only the bits of element IDX that
+   correspond to the bits between START and END, exclusive, are
+   turned on.  IDX must be within elem_idx(START) and
+   elem_idx(END - 1). */
+static inline elem_type
+range_mask (size_t idx, size_t start, size_t end) {
+	elem_type mask = (elem_type) -1;
+
+	if (idx == elem_idx (start))
+		mask &= (elem_type) -1 << (start % ELEM_BITS);
+	if (idx == elem_idx (end - 1) && end % ELEM_BITS != 0)
+		mask &= ((elem_type) 1 << (end % ELEM_BITS)) - 1;
+	return mask;
+}
+
+/* Returns the number of bits turned on in E.  The popcnt
+   instruction is only used if the compiler may assume it, as
+   there is no libgcc to fall back on. */
+static inline size_t
+elem_popcount (elem_type e) {
+#ifdef __POPCNT__
+	return __builtin_popcountll (e);
+#else
+	e = e - ((e >> 1) & 0x5555555555555555UL);
+	e = (e & 0x3333333333333333UL) + ((e >> 2) & 0x3333333333333333UL);
+	e = (e + (e >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (e * 0x0101010101010101UL) >> 56;
+#endif
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or the size of B if there is none.  Skips
+   whole elements whose bits are all set to !VALUE. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value) {
+	size_t idx = elem_idx (start);
+	elem_type e;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+	e = (value ? b->bits[idx] : ~b->bits[idx])
+		& ((elem_type) -1 << (start % ELEM_BITS));
+	while (e == 0) {
+		if (++idx >= elem_cnt (b->bit_cnt))
+			return b->bit_cnt;
+		e = value ? b->bits[idx] : ~b->bits[idx];
+	}
+	start = idx * ELEM_BITS + __builtin_ctzll (e);
+	return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -194,49 +245,64 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is set atomically, but not the whole group. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t i, end = start + cnt;
+	elem_type mask;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	if (cnt == 0)
+		return;
+	for (i = elem_idx (start); i <= elem_idx (end - 1); i++) {
+		mask = range_mask (i, start, end);
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[i]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[i]) : "r" (~mask) : "cc");
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t i, end = start + cnt, true_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	if (cnt == 0)
+		return 0;
+	true_cnt = 0;
+	for (i = elem_idx (start); i <= elem_idx (end - 1); i++)
+		true_cnt += elem_popcount (b->bits[i] & range_mask (i, start, end));
+	return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t i, end = start + cnt;
+	elem_type e;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
+	if (cnt == 0)
+		return false;
+	for (i = elem_idx (start); i <= elem_idx (end - 1); i++) {
+		e = value ? b->bits[i] : ~b->bits[i];
+		if ((e & range_mask (i, start, end)) != 0)
 			return true;
+	}
 	return false;
 }
 
@@ -266,7 +332,9 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Goes from one run of bits set to VALUE to the next, skipping
+   whole elements within and between runs. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
@@ -274,10 +342,15 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
+		size_t i = start, end;
+		if (cnt == 0)
+			return start <= last ? start : BITMAP_ERROR;
+		while ((i = next_bit (b, i, value)) <= last) {
+			end = next_bit (b, i, !value);
+			if (end - i >= cnt)
 				return i;
+			i = end;
+		}
 	}
 	return BITMAP_ERROR;
 }
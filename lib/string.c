@@ -1,5 +1,28 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* memcpy(), memset(), memcmp() and strlen() work on 8-byte words
+   rather than on bytes, and memcpy() and memset() hand the bulk
+   of large blocks, such as whole pages, to `rep movsq' and `rep
+   stosq'.  Words may be unaligned, which x86-64 allows, but
+   memcpy() and memset() first align their destination. */
+
+/* A word, which may alias any object and, if unaligned_word, be
+   unaligned. */
+typedef uint64_t word __attribute__ ((__may_alias__));
+typedef uint64_t unaligned_word __attribute__ ((__may_alias__, __aligned__ (1)));
+
+/* Size of a word. */
+#define WORD_SIZE sizeof (word)
+
+/* Blocks of at least this many bytes are copied or set with a
+   string instruction. */
+#define REP_MIN_SIZE 512
+
+/* A word with every byte set to 0x01 and to 0x80. */
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,6 +34,26 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
+	if (size >= WORD_SIZE) {
+		size_t cnt;
+
+		/* Align DST. */
+		while ((uintptr_t) dst % WORD_SIZE != 0) {
+			*dst++ = *src++;
+			size--;
+		}
+		cnt = size / WORD_SIZE;
+		size %= WORD_SIZE;
+		if (cnt * WORD_SIZE >= REP_MIN_SIZE)
+			asm volatile ("rep movsq"
+					: "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+		else
+			for (; cnt > 0; cnt--) {
+				*(word *) dst = *(const unaligned_word *) src;
+				dst += WORD_SIZE;
+				src += WORD_SIZE;
+			}
+	}
 	while (size-- > 0)
 		*dst++ = *src++;
 
@@ -52,6 +95,10 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip the equal words, then find the differing byte. */
+	for (; size >= WORD_SIZE; a += WORD_SIZE, b += WORD_SIZE, size -= WORD_SIZE)
+		if (*(const unaligned_word *) a != *(const unaligned_word *) b)
+			break;
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -260,6 +307,26 @@ memset (void *dst_, int value, size_t size) {
 
 	ASSERT (dst != NULL || size == 0);
 
+	if (size >= WORD_SIZE) {
+		uint64_t pattern = (unsigned char) value * ONES;
+		size_t cnt;
+
+		/* Align DST. */
+		while ((uintptr_t) dst % WORD_SIZE != 0) {
+			*dst++ = value;
+			size--;
+		}
+		cnt = size / WORD_SIZE;
+		size %= WORD_SIZE;
+		if (cnt * WORD_SIZE >= REP_MIN_SIZE)
+			asm volatile ("rep stosq"
+					: "+D" (dst), "+c" (cnt) : "a" (pattern) : "memory");
+		else
+			for (; cnt > 0; cnt--) {
+				*(word *) dst = pattern;
+				dst += WORD_SIZE;
+			}
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
@@ -270,10 +337,19 @@ memset (void *dst_, int value, size_t size) {
 size_t
 strlen (const char *string) {
 	const char *p;
+	const word *w;
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
+	/* Test bytes up to a word boundary, then whole words: an aligned
+	   word never crosses a page boundary, so reading past the null
+	   terminator is harmless. */
+	for (p = string; (uintptr_t) p % WORD_SIZE != 0; p++)
+		if (*p == '\0')
+			return p - string;
+	for (w = (const word *) p; ((*w - ONES) & ~*w & HIGHS) == 0; w++)
+		continue;
+	for (p = (const char *) w; *p != '\0'; p++)
 		continue;
 	return p - string;
 }
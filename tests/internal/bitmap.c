@@ -0,0 +1,151 @@
+/* Micro-benchmark for scanning and counting in lib/kernel/bitmap.c.
+
+   Runs bitmap_scan(), bitmap_count() and bitmap_contains() on
+   bitmaps filled at several levels, checks their results against
+   reference implementations that test one bit at a time, and
+   prints the timer ticks taken by both.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Number of bits in the bitmaps tested, as in a swap table of
+   16 MiB or a user pool of 64 MiB. */
+#define BIT_CNT 16384
+
+/* Number of times each operation is repeated per fill level. */
+#define ITERATIONS 200
+
+static bool ref_contains (const struct bitmap *, size_t start, size_t cnt,
+                          bool value);
+static size_t ref_count (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static size_t ref_scan (const struct bitmap *, size_t start, size_t cnt,
+                        bool value);
+static void fill (struct bitmap *, int percent);
+
+/* Benchmark the word-at-a-time bitmap functions. */
+void
+test (void)
+{
+  static const int levels[] = {0, 25, 50, 75, 90, 99, 100};
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  size_t i;
+
+  ASSERT (b != NULL);
+  printf ("fill  scan(ref/new)  count(ref/new)  contains(ref/new)\n");
+  for (i = 0; i < sizeof levels / sizeof *levels; i++)
+    {
+      int64_t start, scan_ref, scan_new, count_ref, count_new;
+      int64_t contains_ref, contains_new;
+      size_t cnt, iter;
+
+      fill (b, levels[i]);
+
+      /* Check the results first. */
+      for (cnt = 0; cnt <= 8; cnt++)
+        {
+          ASSERT (bitmap_scan (b, 0, cnt, false) == ref_scan (b, 0, cnt, false));
+          ASSERT (bitmap_scan (b, 7, cnt, true) == ref_scan (b, 7, cnt, true));
+        }
+      ASSERT (bitmap_count (b, 3, BIT_CNT - 5, true)
+              == ref_count (b, 3, BIT_CNT - 5, true));
+      ASSERT (bitmap_contains (b, 1, BIT_CNT - 1, false)
+              == ref_contains (b, 1, BIT_CNT - 1, false));
+
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        ref_scan (b, 0, 1 + iter % 8, false);
+      scan_ref = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        bitmap_scan (b, 0, 1 + iter % 8, false);
+      scan_new = timer_elapsed (start);
+
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        ref_count (b, 0, BIT_CNT, true);
+      count_ref = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        bitmap_count (b, 0, BIT_CNT, true);
+      count_new = timer_elapsed (start);
+
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        ref_contains (b, 0, BIT_CNT, false);
+      contains_ref = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < ITERATIONS; iter++)
+        bitmap_contains (b, 0, BIT_CNT, false);
+      contains_new = timer_elapsed (start);
+
+      printf ("%3d%%  %6lld/%-6lld  %7lld/%-7lld  %8lld/%-8lld\n", levels[i],
+              scan_ref, scan_new, count_ref, count_new,
+              contains_ref, contains_new);
+    }
+  bitmap_destroy (b);
+  printf ("done\n");
+}
+
+/* Sets about PERCENT percent of the bits of B, at random. */
+static void
+fill (struct bitmap *b, int percent)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < percent);
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to VALUE, testing one bit at a time. */
+static bool
+ref_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+/* Returns the number of bits in B between START and START + CNT,
+   exclusive, that are set to VALUE, testing one bit at a time. */
+static size_t
+ref_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Returns the starting index of the first group of CNT bits in B
+   at or after START that are all set to VALUE, testing one bit
+   at a time, or BITMAP_ERROR if there is none. */
+static size_t
+ref_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+
+      for (i = start; i <= last; i++)
+        if (!ref_contains (b, i, cnt, !value))
+          return i;
+    }
+  return BITMAP_ERROR;
+}
@@ -0,0 +1,89 @@
+/* Micro-benchmark for the SSE2 page kernels of threads/fpu.c.
+
+   Runs fpu_page_copy(), fpu_page_zero() and fpu_page_equal() on
+   pages with random contents, checks their results against
+   memcpy(), memset() and memcmp(), and prints the timer ticks
+   taken by both.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "threads/fpu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Number of times each operation is repeated. */
+#define ITERATIONS 16384
+
+/* Takes the results of the functions timed, so that their calls
+   are not discarded. */
+static volatile int sink;
+
+/* Benchmark the SSE2 page kernels. */
+void
+test (void)
+{
+  uint8_t *src = palloc_get_page (PAL_ASSERT);
+  uint8_t *dst = palloc_get_page (PAL_ASSERT);
+  int64_t start, ticks[6];
+  size_t i, iter;
+
+  /* Check the results first. */
+  for (i = 0; i < PGSIZE; i++)
+    src[i] = random_ulong ();
+  fpu_page_copy (dst, src);
+  ASSERT (memcmp (dst, src, PGSIZE) == 0);
+  ASSERT (fpu_page_equal (dst, src));
+  for (i = 0; i < PGSIZE; i += 61)
+    {
+      dst[i]++;
+      ASSERT (!fpu_page_equal (dst, src));
+      dst[i]--;
+    }
+  fpu_page_zero (dst);
+  for (i = 0; i < PGSIZE; i++)
+    ASSERT (dst[i] == 0);
+
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    memcpy (dst, src, PGSIZE);
+  ticks[0] = timer_elapsed (start);
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    fpu_page_copy (dst, src);
+  ticks[1] = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    memset (dst, 0, PGSIZE);
+  ticks[2] = timer_elapsed (start);
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    fpu_page_zero (dst);
+  ticks[3] = timer_elapsed (start);
+
+  memcpy (dst, src, PGSIZE);
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    sink = memcmp (dst, src, PGSIZE);
+  ticks[4] = timer_elapsed (start);
+  start = timer_ticks ();
+  for (iter = 0; iter < ITERATIONS; iter++)
+    sink = fpu_page_equal (dst, src);
+  ticks[5] = timer_elapsed (start);
+
+  printf ("copy(memcpy/sse2)  zero(memset/sse2)  equal(memcmp/sse2)\n");
+  printf ("%6lld/%-10lld  %6lld/%-10lld  %6lld/%-10lld\n",
+          ticks[0], ticks[1], ticks[2], ticks[3], ticks[4], ticks[5]);
+  palloc_free_page (src);
+  palloc_free_page (dst);
+  printf ("done\n");
+}
@@ -0,0 +1,185 @@
+/* Micro-benchmark for the block and string functions of
+   lib/string.c.
+
+   Runs memcpy(), memset(), memcmp() and strlen() on blocks of 16
+   bytes, 512 bytes and 4 kB, checks their results against
+   reference implementations that work one byte at a time, and
+   prints the timer ticks taken by both.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Size of the largest block tested. */
+#define MAX_SIZE 4096
+
+/* Number of bytes processed by each function per block size. */
+#define BYTES (64 * 1024 * 1024)
+
+static void *ref_memcpy (void *, const void *, size_t);
+static void *ref_memset (void *, int, size_t);
+static int ref_memcmp (const void *, const void *, size_t);
+static size_t ref_strlen (const char *);
+static void verify (size_t size);
+
+static char src[MAX_SIZE + 8], dst[MAX_SIZE + 8];
+
+/* Takes the results of the functions timed, so that their calls
+   are not discarded. */
+static volatile size_t sink;
+
+/* Benchmark the word-wide block and string functions. */
+void
+test (void)
+{
+  static const size_t sizes[] = {16, 512, 4096};
+  size_t i;
+
+  printf ("size  memcpy(ref/new)  memset(ref/new)  memcmp(ref/new)  "
+          "strlen(ref/new)\n");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i], iter, iters = BYTES / size;
+      int64_t start, ticks[8];
+
+      verify (size);
+      memset (src, 'a', size);
+      src[size - 1] = '\0';
+      memcpy (dst, src, size);
+
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        ref_memcpy (dst, src, size);
+      ticks[0] = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        memcpy (dst, src, size);
+      ticks[1] = timer_elapsed (start);
+
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        ref_memset (dst, 'a', size);
+      ticks[2] = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        memset (dst, 'a', size);
+      ticks[3] = timer_elapsed (start);
+
+      dst[size - 1] = '\0';
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        sink = ref_memcmp (dst, src, size);
+      ticks[4] = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        sink = memcmp (dst, src, size);
+      ticks[5] = timer_elapsed (start);
+
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        sink = ref_strlen (src);
+      ticks[6] = timer_elapsed (start);
+      start = timer_ticks ();
+      for (iter = 0; iter < iters; iter++)
+        sink = strlen (src);
+      ticks[7] = timer_elapsed (start);
+
+      printf ("%4zu  %6lld/%-7lld  %6lld/%-7lld  %6lld/%-7lld  %6lld/%-7lld\n",
+              size, ticks[0], ticks[1], ticks[2], ticks[3],
+              ticks[4], ticks[5], ticks[6], ticks[7]);
+    }
+  printf ("done\n");
+}
+
+/* Checks the results of the functions on blocks of up to SIZE
+   bytes at every alignment, against the reference ones. */
+static void
+verify (size_t size)
+{
+  static char expected[MAX_SIZE + 8];
+  size_t ofs, len;
+
+  for (ofs = 0; ofs < 8; ofs++)
+    for (len = size - 8; len <= size; len++)
+      {
+        size_t i;
+
+        for (i = 0; i < sizeof src; i++)
+          src[i] = 1 + random_ulong () % 255;
+        memset (dst, 0, sizeof dst);
+        memset (expected, 0, sizeof expected);
+
+        ASSERT (memcpy (dst + ofs, src + 8 - ofs, len) == dst + ofs);
+        ref_memcpy (expected + ofs, src + 8 - ofs, len);
+        ASSERT (ref_memcmp (dst, expected, sizeof dst) == 0);
+
+        ASSERT (memset (dst + ofs, ofs, len) == dst + ofs);
+        ref_memset (expected + ofs, ofs, len);
+        ASSERT (ref_memcmp (dst, expected, sizeof dst) == 0);
+
+        ASSERT (memcmp (dst, expected, sizeof dst) == 0);
+        expected[ofs + len - 1]++;
+        ASSERT (memcmp (dst + ofs, expected + ofs, len) < 0);
+        ASSERT (memcmp (expected + ofs, dst + ofs, len) > 0);
+
+        src[ofs + len - 1] = '\0';
+        ASSERT (strlen (src + ofs) == len - 1);
+        ASSERT (ref_strlen (src + ofs) == len - 1);
+      }
+}
+
+/* Copies SIZE bytes from SRC to DST one byte at a time. */
+static void *
+ref_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+/* Sets the SIZE bytes in DST to VALUE one byte at a time. */
+static void *
+ref_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
+
+/* Compares the blocks of SIZE bytes at A and B one byte at a
+   time. */
+static int
+ref_memcmp (const void *a_, const void *b_, size_t size)
+{
+  const unsigned char *a = a_;
+  const unsigned char *b = b_;
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+/* Returns the length of STRING, testing one byte at a time. */
+static size_t
+ref_strlen (const char *string)
+{
+  const char *p;
+
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
@@ -0,0 +1,41 @@
+/* Maps a file, forks, and unmaps it in the parent.  The child,
+   which inherits the mapping, then reads it, which must still
+   work once the parent's mapping is gone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  int handle;
+  pid_t child;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (actual, 4096, 0, handle, 0) != MAP_FAILED, "mmap \"sample.txt\"");
+  close (handle);
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      /* Wait until the parent has unmapped the file. */
+      while ((handle = open ("unmapped")) == -1)
+        continue;
+      close (handle);
+      CHECK (!memcmp (actual, sample, strlen (sample)),
+             "check mmap'd data in child");
+      exit (0);
+    }
+
+  quiet = true;
+  munmap (actual);
+  CHECK (create ("unmapped", 0), "create \"unmapped\"");
+  quiet = false;
+  CHECK (wait (child) == 0, "wait for child (should return 0)");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-fork-unmap) begin
+(mmap-fork-unmap) open "sample.txt"
+(mmap-fork-unmap) mmap "sample.txt"
+(mmap-fork-unmap) check mmap'd data in child
+(mmap-fork-unmap) wait for child (should return 0)
+(mmap-fork-unmap) end
+EOF
+pass;
@@ -0,0 +1,335 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* FPU context switching.
+
+   The kernel itself is built without floating point or SSE
+   (-msoft-float -mno-sse), so the x87, MMX and SSE registers
+   belong to user programs only.  They are switched lazily: the
+   registers hold the state of at most one thread, the "owner",
+   and the scheduler sets CR0.TS whenever it runs any other
+   thread.  The first FPU or SSE instruction of that thread then
+   raises a #NM exception, whose handler saves the registers of
+   the owner with FXSAVE, loads those of the current thread with
+   FXRSTOR and makes it the owner.  Threads that never use the
+   FPU, which includes every kernel thread, cost nothing but the
+   CR0 write when they are switched to.
+
+   A thread's state area is allocated on its first #NM, starting
+   from the state left by FNINIT, and freed when it exits or
+   executes a new program.
+
+   The kernel may use the SSE registers between
+   kernel_fpu_begin() and kernel_fpu_end(), with interrupts
+   turned off.  The state of the owner is saved first, so the
+   owner reloads it on its next FPU instruction.
+
+   We use FXSAVE rather than XSAVE: it covers x87 and SSE, which
+   is all that user programs are built for, and XSAVE is not
+   available on every CPU we run on. */
+
+/* CR0 and CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP (1 << 1)         /* Monitor coprocessor. */
+#define CR0_EM (1 << 2)         /* Emulation. */
+#define CR0_TS (1 << 3)         /* Task switched. */
+#define CR0_NE (1 << 5)         /* Numeric error. */
+#define CR4_OSFXSR (1 << 9)     /* FXSAVE, FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT (1 << 10) /* Unmasked SSE exceptions raise #XF. */
+
+/* MXCSR with all SSE exceptions masked, as after reset. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* Thread whose state is in the registers, or null. */
+static struct thread *fpu_owner;
+
+/* True if CR0.TS is set. */
+static bool ts_set;
+
+/* Registers after FNINIT, copied into each new state area. */
+static struct fpu_state fpu_initial;
+
+/* State areas. */
+static struct slab_cache fpu_slab;
+
+/* Kernel use of the FPU. */
+static bool kernel_fpu_active;          /* In kernel_fpu_begin()? */
+static enum intr_level kernel_fpu_level; /* Interrupt level to restore. */
+
+/* Statistics. */
+static long long trap_cnt;      /* #NM exceptions taken. */
+static long long save_cnt;      /* States saved by FXSAVE. */
+static long long kernel_cnt;    /* Calls to kernel_fpu_begin(). */
+
+static void fpu_trap (struct intr_frame *);
+
+static inline void
+fxsave (struct fpu_state *state) {
+	asm volatile ("fxsave64 %0" : "=m" (*state));
+}
+
+static inline void
+fxrstor (const struct fpu_state *state) {
+	asm volatile ("fxrstor64 %0" : : "m" (*state));
+}
+
+/* Clears CR0.TS, if it is set. */
+static void
+ts_clear (void) {
+	if (ts_set) {
+		clts ();
+		ts_set = false;
+	}
+}
+
+/* Sets CR0.TS, if it is clear. */
+static void
+ts_raise (void) {
+	if (!ts_set) {
+		lcr0 (rcr0 () | CR0_TS);
+		ts_set = true;
+	}
+}
+
+/* Saves the registers into the state area of their owner, if
+   any, leaving it the owner.  CR0.TS is left set unless the
+   owner is the running thread.  Interrupts must be off. */
+static void
+save_owner (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (fpu_owner == NULL)
+		return;
+	ts_clear ();
+	fxsave (fpu_owner->fpu);
+	save_cnt++;
+	if (fpu_owner != thread_current ())
+		ts_raise ();
+}
+
+/* Enables the FPU and SSE, records the initial state of the
+   registers and registers the #NM handler. */
+void
+fpu_init (void) {
+	uint32_t mxcsr = MXCSR_DEFAULT;
+
+	lcr0 ((rcr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+	lcr4 (rcr4 () | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	asm volatile ("fninit; ldmxcsr %0" : : "m" (mxcsr));
+	fxsave (&fpu_initial);
+
+	/* FXSAVE and FXRSTOR fault on areas not aligned to 16 bytes. */
+	slab_cache_init (&fpu_slab, "fpu", sizeof (struct fpu_state),
+			_Alignof (struct fpu_state), NULL);
+	intr_register_int (7, 0, INTR_ON, fpu_trap,
+			"#NM Device Not Available Exception");
+
+	/* No thread owns the registers yet. */
+	ts_set = false;
+	ts_raise ();
+}
+
+/* #NM handler: gives the registers to the current thread, which
+   tried to use them while CR0.TS was set. */
+static void
+fpu_trap (struct intr_frame *f) {
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+
+	if (f->cs != SEL_UCSEG) {
+		/* The kernel uses the FPU only between kernel_fpu_begin()
+		   and kernel_fpu_end(), with CR0.TS clear. */
+		intr_dump_frame (f);
+		PANIC ("Kernel bug - FPU used outside kernel_fpu_begin()");
+	}
+
+	if (t->fpu == NULL) {
+		t->fpu = slab_alloc (&fpu_slab);
+		if (t->fpu == NULL)
+			thread_exit (-1);
+		ASSERT ((uintptr_t) t->fpu % 16 == 0);
+		memcpy (t->fpu, &fpu_initial, sizeof *t->fpu);
+	}
+
+	old_level = intr_disable ();
+	trap_cnt++;
+	if (fpu_owner != t) {
+		save_owner ();
+		ts_clear ();
+		fxrstor (t->fpu);
+		fpu_owner = t;
+	} else
+		ts_clear ();
+	intr_set_level (old_level);
+}
+
+/* Sets CR0.TS for switching to NEXT, so that its first FPU
+   instruction traps unless it already owns the registers.
+   Called by the scheduler, with interrupts off. */
+void
+fpu_switch (struct thread *next) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!kernel_fpu_active);
+
+	if (next == fpu_owner)
+		ts_clear ();
+	else
+		ts_raise ();
+}
+
+/* Gives DST a copy of the FPU state of SRC, for fork().
+   Returns false if memory is not available. */
+bool
+fpu_copy (struct thread *dst, struct thread *src) {
+	enum intr_level old_level;
+
+	ASSERT (dst != src);
+
+	if (src->fpu == NULL)
+		return true;
+	if (dst->fpu == NULL) {
+		dst->fpu = slab_alloc (&fpu_slab);
+		if (dst->fpu == NULL)
+			return false;
+		ASSERT ((uintptr_t) dst->fpu % 16 == 0);
+	}
+
+	old_level = intr_disable ();
+	if (fpu_owner == src)
+		save_owner ();
+	memcpy (dst->fpu, src->fpu, sizeof *dst->fpu);
+	if (fpu_owner == dst) {
+		/* Make DST load its new state. */
+		fpu_owner = NULL;
+		ts_raise ();
+	}
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Frees the FPU state of T, which will start over from the
+   initial state on its next FPU instruction. */
+void
+fpu_release (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	struct fpu_state *state = t->fpu;
+
+	if (fpu_owner == t) {
+		fpu_owner = NULL;
+		ts_raise ();
+	}
+	t->fpu = NULL;
+	intr_set_level (old_level);
+
+	slab_free (&fpu_slab, state);
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) {
+	printf ("FPU: %lld traps, %lld saves, %lld kernel uses\n",
+			trap_cnt, save_cnt, kernel_cnt);
+}
+
+/* Lets the kernel use the SSE registers until kernel_fpu_end().
+   Turns off interrupts meanwhile, and may not be nested. */
+void
+kernel_fpu_begin (void) {
+	enum intr_level old_level = intr_disable ();
+
+	ASSERT (!kernel_fpu_active);
+	kernel_fpu_active = true;
+	kernel_fpu_level = old_level;
+	kernel_cnt++;
+
+	save_owner ();
+	fpu_owner = NULL;
+	ts_clear ();
+}
+
+/* Ends the use of the SSE registers by the kernel. */
+void
+kernel_fpu_end (void) {
+	ASSERT (kernel_fpu_active);
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	ts_raise ();
+	kernel_fpu_active = false;
+	intr_set_level (kernel_fpu_level);
+}
+
+/* Copies the page at SRC to the page at DST, 64 bytes at a time
+   through the SSE registers. */
+void
+fpu_page_copy (void *dst_, const void *src_) {
+	uint8_t *dst = dst_;
+	const uint8_t *src = src_;
+	size_t ofs;
+
+	ASSERT (pg_ofs (dst) == 0 && pg_ofs (src) == 0);
+
+	kernel_fpu_begin ();
+	for (ofs = 0; ofs < PGSIZE; ofs += 64)
+		asm volatile ("movdqa 0(%1), %%xmm0\n\t"
+				"movdqa 16(%1), %%xmm1\n\t"
+				"movdqa 32(%1), %%xmm2\n\t"
+				"movdqa 48(%1), %%xmm3\n\t"
+				"movdqa %%xmm0, 0(%0)\n\t"
+				"movdqa %%xmm1, 16(%0)\n\t"
+				"movdqa %%xmm2, 32(%0)\n\t"
+				"movdqa %%xmm3, 48(%0)"
+				: : "r" (dst + ofs), "r" (src + ofs) : "memory");
+	kernel_fpu_end ();
+}
+
+/* Fills the page at DST with zeros, 64 bytes at a time through
+   the SSE registers. */
+void
+fpu_page_zero (void *dst_) {
+	uint8_t *dst = dst_;
+	size_t ofs;
+
+	ASSERT (pg_ofs (dst) == 0);
+
+	kernel_fpu_begin ();
+	asm volatile ("pxor %xmm0, %xmm0");
+	for (ofs = 0; ofs < PGSIZE; ofs += 64)
+		asm volatile ("movdqa %%xmm0, 0(%0)\n\t"
+				"movdqa %%xmm0, 16(%0)\n\t"
+				"movdqa %%xmm0, 32(%0)\n\t"
+				"movdqa %%xmm0, 48(%0)"
+				: : "r" (dst + ofs) : "memory");
+	kernel_fpu_end ();
+}
+
+/* Returns true if the pages at A and B hold the same bytes,
+   comparing 32 bytes at a time through the SSE registers and
+   stopping at the first difference. */
+bool
+fpu_page_equal (const void *a_, const void *b_) {
+	const uint8_t *a = a_;
+	const uint8_t *b = b_;
+	int mask = 0xffff;
+	size_t ofs;
+
+	ASSERT (pg_ofs (a) == 0 && pg_ofs (b) == 0);
+
+	kernel_fpu_begin ();
+	for (ofs = 0; ofs < PGSIZE && mask == 0xffff; ofs += 32)
+		asm volatile ("movdqa 0(%1), %%xmm0\n\t"
+				"movdqa 16(%1), %%xmm1\n\t"
+				"pcmpeqb 0(%2), %%xmm0\n\t"
+				"pcmpeqb 16(%2), %%xmm1\n\t"
+				"pand %%xmm1, %%xmm0\n\t"
+				"pmovmskb %%xmm0, %0"
+				: "=r" (mask) : "r" (a + ofs), "r" (b + ofs) : "memory");
+	kernel_fpu_end ();
+	return mask == 0xffff;
+}
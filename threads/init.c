@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -20,6 +21,7 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -85,6 +87,7 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	slab_init ();
 	paging_init (mem_end);
 
 #ifdef USERPROG
@@ -94,6 +97,7 @@ main (void) {
 
 	/* Initialize interrupt handlers. */
 	intr_init ();
+	fpu_init ();
 	timer_init ();
 	kbd_init ();
 	input_init ();
@@ -226,6 +230,33 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-wb")) {
+			char *high = value ? strchr (value, ':') : NULL;
+			if (high == NULL)
+				PANIC ("option `-wb' requires LOW:HIGH (use -h for help)");
+			vm_writeback_low = atoi (value);
+			vm_writeback_high = atoi (high + 1);
+		}
+		else if (!strcmp (name, "-fa"))
+			vm_fault_around = atoi (value);
+		else if (!strcmp (name, "-lp"))
+			vm_large_max = atoi (value);
+		else if (!strcmp (name, "-zs"))
+			vm_zswap_max = atoi (value);
+		else if (!strcmp (name, "-ksm")) {
+			char *sleep = value ? strchr (value, ':') : NULL;
+			if (value == NULL)
+				PANIC ("option `-ksm' requires PAGES[:MS] (use -h for help)");
+			vm_ksm_pages = atoi (value);
+			if (sleep != NULL)
+				vm_ksm_sleep = atoi (sleep + 1);
+		}
+		else if (!strcmp (name, "-rss"))
+			vm_rss_limit = atoi (value);
+		else if (!strcmp (name, "-ws"))
+			vm_ws_sleep = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -328,6 +359,19 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -wb=LOW:HIGH       Evict pages in the background when fewer than\n"
+			"                     LOW user pages are free, up to HIGH (0:0 disables).\n"
+			"  -fa=COUNT          Load up to COUNT pages of a file per page fault.\n"
+			"  -lp=COUNT          Use up to COUNT 2 MiB pages (0 disables).\n"
+			"  -zs=PAGES          Keep up to PAGES pages of compressed swapped out\n"
+			"                     pages in memory (0 keeps only same-filled ones).\n"
+			"  -ksm=PAGES[:MS]    Scan PAGES frames every MS (100) milliseconds to\n"
+			"                     merge the same anonymous pages (0 disables).\n"
+			"  -rss=PAGES         Limit each process to PAGES resident pages.\n"
+			"  -ws=MS             Sample the working sets every MS milliseconds, to\n"
+			"                     share memory out in proportion to them.\n"
 #endif
 			);
 	power_off ();
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,30 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of each descriptor, a "magazine" caches up to
+   MAG_SIZE free blocks on a stack, so that most requests are
+   served without taking the descriptor's lock.  An empty
+   magazine is refilled with MAG_BATCH blocks at once, and a full
+   one is drained by as many.  As there is a single CPU, the
+   magazines are per-CPU: they are only accessed with interrupts
+   off.  The blocks in a magazine are still in use for their
+   arenas, which are only given back once these blocks are
+   drained. */
+
+/* Capacity of a magazine, and number of blocks moved between a
+   magazine and its descriptor at once. */
+#define MAG_SIZE 16
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* Magazine. */
+struct magazine {
+	size_t cnt;                 /* Number of blocks in ROUNDS. */
+	struct block *rounds[MAG_SIZE]; /* Free blocks, last freed on top. */
+	long long hits;             /* Requests served by the magazine. */
+	long long misses;           /* Requests that refilled it. */
+};
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +64,7 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+	struct magazine mag;        /* Cache of free blocks. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -63,6 +88,7 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void desc_put (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -76,6 +102,8 @@ malloc_init (void) {
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+		d->mag.cnt = 0;
+		d->mag.hits = d->mag.misses = 0;
 	}
 }
 
@@ -86,6 +114,7 @@ malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
+	enum intr_level old_level;
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
@@ -112,6 +141,16 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
+	/* Take the block on top of the magazine, if any. */
+	old_level = intr_disable ();
+	if (d->mag.cnt > 0) {
+		b = d->mag.rounds[--d->mag.cnt];
+		d->mag.hits++;
+		intr_set_level (old_level);
+		return b;
+	}
+	intr_set_level (old_level);
+
 	lock_acquire (&d->lock);
 
 	/* If the free list is empty, create a new arena. */
@@ -135,10 +174,18 @@ malloc (size_t size) {
 		}
 	}
 
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
+	/* Refill the magazine from the free list, and return the block
+	   on top of it. */
+	old_level = intr_disable ();
+	d->mag.misses++;
+	while (d->mag.cnt < MAG_BATCH && !list_empty (&d->free_list)) {
+		b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+		a = block_to_arena (b);
+		a->free_cnt--;
+		d->mag.rounds[d->mag.cnt++] = b;
+	}
+	b = d->mag.rounds[--d->mag.cnt];
+	intr_set_level (old_level);
 	lock_release (&d->lock);
 	return b;
 }
@@ -207,29 +254,34 @@ free (void *p) {
 
 		if (d != NULL) {
 			/* It's a normal block.  We handle it here. */
+			struct block *batch[MAG_BATCH];
+			enum intr_level old_level;
+			size_t i, cnt = 0;
 
 #ifndef NDEBUG
 			/* Clear the block to help detect use-after-free bugs. */
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			/* Put the block on top of the magazine, if there is room. */
+			old_level = intr_disable ();
+			if (d->mag.cnt < MAG_SIZE) {
+				d->mag.rounds[d->mag.cnt++] = b;
+				intr_set_level (old_level);
+				return;
 			}
+			intr_set_level (old_level);
 
+			/* Otherwise, drain the magazine into the free list along with
+			   the block. */
+			lock_acquire (&d->lock);
+			old_level = intr_disable ();
+			while (cnt < MAG_BATCH && d->mag.cnt > 0)
+				batch[cnt++] = d->mag.rounds[--d->mag.cnt];
+			intr_set_level (old_level);
+			desc_put (d, b);
+			for (i = 0; i < cnt; i++)
+				desc_put (d, batch[i]);
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
@@ -239,6 +291,44 @@ free (void *p) {
 	}
 }
 
+/* Prints the hits and misses of the magazine of each size class
+   that has served any request. */
+void
+malloc_print_stats (void) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->mag.hits + d->mag.misses > 0)
+			printf ("Malloc %zu bytes: %lld magazine hits, %lld misses\n",
+					d->block_size, d->mag.hits, d->mag.misses);
+}
+
+/* Adds block B to the free list of D, giving back its arena to the
+   page allocator if it is now entirely unused.
+   D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+	ASSERT (a->desc == d);
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		palloc_free_page (a);
+	}
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -23,11 +23,34 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		/* The entry of a large page plays the role of its page table entry. */
+		if (pdp[idx] & PTE_PS)
+			return &pdp[idx];
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, creating the upper level tables if CREATE
+ * is true, or a null pointer. */
+static uint64_t *
+pml4_pde_walk (uint64_t *pml4, const uint64_t va, bool create) {
+	uint64_t *table = pml4;
+	uint64_t *new_page;
+	int idx[2] = { PML4 (va), PDPE (va) };
+
+	for (int i = 0; i < 2; i++) {
+		if (!(table[idx[i]] & PTE_P)) {
+			if (!create || !(new_page = palloc_get_page (PAL_ZERO)))
+				return NULL;
+			table[idx[i]] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (table[idx[i]]));
+	}
+	return &table[PDX (va)];
+}
+
 static uint64_t *
 pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -122,10 +145,17 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+				pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -169,7 +199,8 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* The frames of large pages are not owned by the page tables. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -216,8 +247,11 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & LPGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -238,11 +272,61 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
+	ASSERT (!pte || !(*pte & PTE_PS)); /* Not within a large page. */
 	if (pte)
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
 	return pte != NULL;
 }
 
+/* Maps the large user virtual page UPAGE in PML4 to the LPGSIZE
+ * bytes of physical memory starting at kernel virtual address
+ * KPAGE, with a single page directory entry. Both must be aligned
+ * to LPGSIZE. No page of UPAGE's range may be mapped; the page
+ * table left by former mappings, if any, is freed.
+ * Returns true if successful, false if memory allocation
+ * failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde, *pt;
+
+	ASSERT (((uint64_t) upage & LPGMASK) == 0);
+	ASSERT ((vtop (kpage) & LPGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pml4_pde_walk (pml4, (uint64_t) upage, true);
+	if (!pde)
+		return false;
+	if ((*pde & PTE_P) && !(*pde & PTE_PS)) {
+		pt = ptov (PTE_ADDR (*pde));
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			ASSERT (!(pt[i] & PTE_P));
+		*pde = 0;
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) upage);
+		palloc_free_page (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Removes the mapping of the large user virtual page UPAGE from
+ * PML4, if any. */
+void
+pml4_clear_large_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde;
+
+	ASSERT (((uint64_t) upage & LPGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pde = pml4_pde_walk (pml4, (uint64_t) upage, false);
+	if (pde != NULL && (*pde & PTE_PS) != 0) {
+		*pde = 0;
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) upage);
+	}
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -281,7 +365,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
-			*pte &= ~(uint32_t) PTE_D;
+			*pte &= ~(uint64_t) PTE_D;
 
 		if (rcr3 () == vtop (pml4))
 			invlpg ((uint64_t) vpage);
@@ -307,7 +391,23 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
-			*pte &= ~(uint32_t) PTE_A;
+			*pte &= ~(uint64_t) PTE_A;
+
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) vpage);
+	}
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PML4, preserving the rest of its bits. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
 
 		if (rcr3 () == vtop (pml4))
 			invlpg ((uint64_t) vpage);
@@ -2,14 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +25,37 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a buddy system: Its free pages are kept in blocks
+   of 2**ORDER pages, aligned to their size in physical memory,
+   on one free list per order.  An allocation splits the smallest
+   large enough block, and a block being freed is merged with its
+   buddy, the other half of the block of the next order, while
+   the buddy is free too.  Both take O(MAX_ORDER) steps. */
+
+/* Largest order of a block: 2**18 pages, i.e. 1 GiB. */
+#define MAX_ORDER 18
+
+/* Per-page data of a pool. */
+struct block {
+	struct list_elem elem;          /* Element in the free list. */
+	int8_t order;                   /* Order of the free block starting
+	                                   at the page, -1 if none. */
+};
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct block *blocks;           /* One entry per page of the pool. */
+	size_t ofs;                     /* Physical page number of BASE modulo
+	                                   2**MAX_ORDER, so that page IDX of the
+	                                   pool is page OFS + IDX of an aligned
+	                                   block of order MAX_ORDER. */
+	size_t free_cnt;                /* Number of free pages. */
+	struct list free[MAX_ORDER + 1];    /* Free blocks of each order. */
+	size_t block_cnt[MAX_ORDER + 1];    /* Number of blocks in FREE. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +67,11 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt, size_t order);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void pool_release (struct pool *, size_t page_idx, size_t page_cnt);
+static void pool_push (struct pool *, size_t idx, size_t order);
+static void pool_print_stats (const char *name, const struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -223,12 +253,12 @@ split:
 			page_idx = pg_no (start) - pg_no (pool->base);
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool_free (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool_free (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -262,10 +292,11 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t order = 0;
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	size_t page_idx = pool_alloc (pool, page_cnt, order);
 	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
@@ -284,6 +315,36 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Obtains PAGE_CNT contiguous free pages, as
+   palloc_get_multiple(), whose physical address is aligned to
+   PAGE_CNT pages, so that they can back a large page. PAGE_CNT
+   must be a power of 2. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx, order = 0;
+	void *pages = NULL;
+
+	ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+	/* Blocks are aligned to their size. */
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	page_idx = pool_alloc (pool, page_cnt, order);
+	if (page_idx != BITMAP_ERROR)
+		pages = pool->base + PGSIZE * page_idx;
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, PGSIZE * page_cnt);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -319,7 +380,7 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool_free (pool, page_idx, page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -328,23 +389,158 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the base address of the user pool and stores in *PAGE_CNT the
+   number of pages it spans, so that user frames can be indexed by
+   their page number relative to the pool's base. */
+void *
+palloc_user_pool (size_t *page_cnt) {
+	ASSERT (page_cnt != NULL);
+	*page_cnt = bitmap_size (user_pool.used_map);
+	return user_pool.base;
+}
+
+/* Prints the free pages of both pools, and how fragmented they
+   are. */
+void
+palloc_print_stats (void) {
+	pool_print_stats ("Kernel", &kernel_pool);
+	pool_print_stats ("User", &user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map at its base, followed by its
+     per-page data.  Calculate the space needed for them
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t blk_pages = DIV_ROUND_UP (pgcnt * sizeof *p->blocks, PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->blocks = (struct block *) ((uint8_t *) *bm_base + bm_pages);
+	p->ofs = pg_no (vtop (p->base)) % ((size_t) 1 << MAX_ORDER);
+	p->free_cnt = 0;
+	for (size_t i = 0; i <= MAX_ORDER; i++) {
+		list_init (&p->free[i]);
+		p->block_cnt[i] = 0;
+	}
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	for (size_t i = 0; i < pgcnt; i++)
+		p->blocks[i].order = -1;
+
+	*bm_base += bm_pages + blk_pages;
+}
+
+/* Takes a block of 2**ORDER free pages of P, and gives back
+   all of them but the first PAGE_CNT.  Returns the index of the
+   first page, or BITMAP_ERROR if there is no such block. */
+static size_t
+pool_alloc (struct pool *p, size_t page_cnt, size_t order) {
+	struct block *b;
+	enum intr_level old_level;
+	size_t idx = BITMAP_ERROR, o;
+
+	if (order > MAX_ORDER)
+		return BITMAP_ERROR;
+
+	/* The free lists are updated with interrupts off rather than
+	   under a lock, as the scheduler frees the pages of dying
+	   threads with interrupts off. */
+	old_level = intr_disable ();
+	for (o = order; o <= MAX_ORDER && list_empty (&p->free[o]); o++)
+		continue;
+	if (o <= MAX_ORDER) {
+		b = list_entry (list_pop_front (&p->free[o]), struct block, elem);
+		ASSERT (b->order == (int8_t) o);
+		b->order = -1;
+		p->block_cnt[o]--;
+		idx = b - p->blocks;
+		/* Split the block, giving back the upper halves. */
+		while (o > order) {
+			o--;
+			pool_push (p, idx + ((size_t) 1 << o), o);
+		}
+		p->free_cnt -= (size_t) 1 << order;
+		pool_release (p, idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+		bitmap_set_multiple (p->used_map, idx, page_cnt, true);
+	}
+	intr_set_level (old_level);
+	return idx;
+}
+
+/* Frees the PAGE_CNT pages of P starting at PAGE_IDX. */
+static void
+pool_free (struct pool *p, size_t page_idx, size_t page_cnt) {
+	enum intr_level old_level = intr_disable ();
+
+	bitmap_set_multiple (p->used_map, page_idx, page_cnt, false);
+	pool_release (p, page_idx, page_cnt);
+	intr_set_level (old_level);
+}
 
-	*bm_base += bm_pages;
+/* Gives back the PAGE_CNT pages of P starting at PAGE_IDX, as
+   the largest aligned blocks they can be split into, merging
+   each of them with its buddies while free.
+   Interrupts must be off. */
+static void
+pool_release (struct pool *p, size_t page_idx, size_t page_cnt) {
+	size_t idx, buddy, order;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	p->free_cnt += page_cnt;
+	while (page_cnt > 0) {
+		/* Orders are relative to the physical page number. */
+		idx = p->ofs + page_idx;
+		for (order = 0; order < MAX_ORDER && (idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt; order++)
+			continue;
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+
+		for (; order < MAX_ORDER; order++) {
+			buddy = (idx ^ ((size_t) 1 << order)) - p->ofs;
+			if (buddy >= bitmap_size (p->used_map)
+					|| p->blocks[buddy].order != (int8_t) order)
+				break;
+			list_remove (&p->blocks[buddy].elem);
+			p->blocks[buddy].order = -1;
+			p->block_cnt[order]--;
+			idx &= ~((size_t) 1 << order);
+		}
+		pool_push (p, idx - p->ofs, order);
+	}
+}
+
+/* Adds the block of 2**ORDER free pages of P starting at page
+   IDX to its free list.
+   Interrupts must be off. */
+static void
+pool_push (struct pool *p, size_t idx, size_t order) {
+	struct block *b = &p->blocks[idx];
+
+	b->order = order;
+	list_push_front (&p->free[order], &b->elem);
+	p->block_cnt[order]++;
+}
+
+/* Prints the number of free pages of P, named NAME, the number of
+   blocks they are split into and the largest of them. */
+static void
+pool_print_stats (const char *name, const struct pool *p) {
+	size_t blocks = 0, largest = 0;
+
+	for (size_t i = 0; i <= MAX_ORDER; i++)
+		if (p->block_cnt[i] > 0) {
+			blocks += p->block_cnt[i];
+			largest = (size_t) 1 << i;
+		}
+	printf ("%s pool: %zu free pages in %zu blocks, largest %zu pages\n",
+			name, p->free_cnt, blocks, largest);
 }
 
 /* Returns true if PAGE was allocated from POOL,
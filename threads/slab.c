@@ -0,0 +1,237 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* An object cache allocator, after the slab allocator of SunOS.
+
+   Unlike malloc(), which rounds each request up to a power of 2
+   and serves all requests of a size class from a single
+   descriptor, each cache serves objects of a single type, packed
+   with no rounding but to the alignment of the type, and at
+   least to pointer alignment.  Caches are meant
+   for the small objects that the kernel creates and destroys at
+   a high rate, such as the pages of the virtual memory.
+
+   Each slab is a page obtained from the page allocator, with its
+   header at the beginning followed by its objects.  The free
+   objects of a slab are linked through their first bytes.  A
+   cache keeps the slabs with free objects in a list, most
+   recently freed into first, so that allocations are served
+   from few slabs and the others may empty.  Up to
+   SLAB_EMPTY_MAX empty slabs are kept for the next allocations,
+   the others are given back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Number of empty slabs kept by a cache. */
+#define SLAB_EMPTY_MAX 1
+
+/* Slab header. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct slab_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in the cache's PARTIAL list. */
+	size_t free_cnt;            /* Number of free objects. */
+	struct free_obj *free;      /* First free object. */
+};
+
+/* Free object. */
+struct free_obj {
+	struct free_obj *next;      /* Next free object of the slab. */
+};
+
+/* List of all caches. */
+static struct list caches;
+
+static struct slab *obj_to_slab (void *obj);
+
+/* Initializes the slab allocator. */
+void
+slab_init (void) {
+	list_init (&caches);
+}
+
+/* Initializes CACHE for objects of SIZE bytes, named NAME, whose
+   addresses are multiples of ALIGN, a power of 2 no greater than
+   the page size (e.g. _Alignof the objects' type).  CTOR, if
+   non-null, initializes each object allocated. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+		size_t align, slab_ctor_func *ctor) {
+	ASSERT (cache != NULL);
+	ASSERT (size > 0);
+	ASSERT (align > 0 && (align & (align - 1)) == 0 && align <= PGSIZE);
+
+	cache->name = name;
+	if (size < sizeof (struct free_obj))
+		size = sizeof (struct free_obj);
+	if (align < sizeof (void *))
+		align = sizeof (void *);
+	cache->obj_size = ROUND_UP (size, align);
+	cache->objs_ofs = ROUND_UP (sizeof (struct slab), align);
+	ASSERT (cache->objs_ofs < PGSIZE);
+	cache->objs_per_slab = (PGSIZE - cache->objs_ofs) / cache->obj_size;
+	ASSERT (cache->objs_per_slab > 0);
+	cache->ctor = ctor;
+	list_init (&cache->partial);
+	lock_init (&cache->lock);
+	cache->slab_cnt = cache->empty_cnt = 0;
+	cache->in_use = cache->peak = 0;
+	cache->alloc_cnt = cache->free_cnt = cache->grow_cnt = 0;
+	list_push_back (&caches, &cache->elem);
+}
+
+/* Adds a new slab to CACHE, which must be locked.
+   Returns false if memory is not available. */
+static bool
+slab_grow (struct slab_cache *cache) {
+	struct slab *s = palloc_get_page (0);
+	uint8_t *obj;
+	size_t i;
+
+	if (s == NULL)
+		return false;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = cache;
+	s->free_cnt = cache->objs_per_slab;
+	s->free = NULL;
+	/* Link the objects in address order. */
+	obj = (uint8_t *) s + cache->objs_ofs
+			+ (cache->objs_per_slab - 1) * cache->obj_size;
+	for (i = 0; i < cache->objs_per_slab; i++, obj -= cache->obj_size) {
+		struct free_obj *f = (struct free_obj *) obj;
+		f->next = s->free;
+		s->free = f;
+	}
+	list_push_front (&cache->partial, &s->elem);
+	cache->slab_cnt++;
+	cache->empty_cnt++;
+	cache->grow_cnt++;
+	return true;
+}
+
+/* Obtains and returns a new object of CACHE.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache) {
+	struct slab *s;
+	struct free_obj *f;
+
+	ASSERT (cache != NULL);
+
+	lock_acquire (&cache->lock);
+
+	/* If no slab has free objects, get a new one. */
+	if (list_empty (&cache->partial) && !slab_grow (cache)) {
+		lock_release (&cache->lock);
+		return NULL;
+	}
+
+	/* Take the first free object of the first slab, which leaves the
+	   list once full. */
+	s = list_entry (list_front (&cache->partial), struct slab, elem);
+	ASSERT (s->magic == SLAB_MAGIC && s->free_cnt > 0);
+	if (s->free_cnt-- == cache->objs_per_slab)
+		cache->empty_cnt--;
+	f = s->free;
+	s->free = f->next;
+	if (s->free_cnt == 0)
+		list_remove (&s->elem);
+
+	cache->alloc_cnt++;
+	if (++cache->in_use > cache->peak)
+		cache->peak = cache->in_use;
+	lock_release (&cache->lock);
+
+	if (cache->ctor != NULL)
+		cache->ctor (f);
+	return f;
+}
+
+/* Frees OBJ, which must have been previously allocated from
+   CACHE with slab_alloc(). */
+void
+slab_free (struct slab_cache *cache, void *obj) {
+	struct slab *s;
+	struct free_obj *f = obj;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (obj);
+	ASSERT (s->cache == cache);
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs. */
+	memset (obj, 0xcc, cache->obj_size);
+#endif
+
+	lock_acquire (&cache->lock);
+
+	/* Add the object to its slab, which gets back into the list if it was
+	   full. */
+	if (s->free_cnt == 0)
+		list_push_front (&cache->partial, &s->elem);
+	f->next = s->free;
+	s->free = f;
+	cache->free_cnt++;
+	cache->in_use--;
+
+	/* If the slab is now entirely unused, keep it for the next
+	   allocations, or free it. */
+	if (++s->free_cnt == cache->objs_per_slab) {
+		if (cache->empty_cnt < SLAB_EMPTY_MAX) {
+			cache->empty_cnt++;
+			/* Allocate from the slabs in use first. */
+			list_remove (&s->elem);
+			list_push_back (&cache->partial, &s->elem);
+		} else {
+			list_remove (&s->elem);
+			cache->slab_cnt--;
+			s->magic = 0;
+			palloc_free_page (s);
+		}
+	}
+
+	lock_release (&cache->lock);
+}
+
+/* Prints the statistics of the caches that have been used. */
+void
+slab_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+
+		if (c->alloc_cnt == 0)
+			continue;
+		printf ("Slab %s: %zu bytes, %zu in use, %zu peak, %lld allocs, "
+				"%lld frees, %zu slabs, %lld grown\n",
+				c->name, c->obj_size, c->in_use, c->peak, c->alloc_cnt,
+				c->free_cnt, c->slab_cnt, c->grow_cnt);
+	}
+}
+
+/* Returns the slab that object OBJ is inside. */
+static struct slab *
+obj_to_slab (void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid. */
+	ASSERT (s != NULL);
+	ASSERT (s->magic == SLAB_MAGIC);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= s->cache->objs_ofs);
+	ASSERT ((pg_ofs (obj) - s->cache->objs_ofs) % s->cache->obj_size == 0);
+
+	return s;
+}
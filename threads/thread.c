@@ -5,9 +5,11 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/fpa.h"
@@ -213,6 +215,17 @@ void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+#ifdef VM
+	printf ("Zeroed frames: %lld hits, %lld misses\n",
+			vm_zero_hits, vm_zero_misses);
+	zswap_print_stats ();
+	printf ("Merged frames: %lld\n", vm_ksm_merged);
+	printf ("Shared text pages: %lld\n", vm_text_shared);
+#endif
+	fpu_print_stats ();
+	malloc_print_stats ();
+	slab_print_stats ();
+	palloc_print_stats ();
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -372,6 +385,8 @@ thread_exit (int status) {
 #ifdef USERPROG
 	process_exit (status);
 #endif
+	fpu_release (thread_current ());
+
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
@@ -596,6 +611,15 @@ idle (void *idle_started_ UNUSED) {
 		intr_disable ();
 		thread_block ();
 
+#ifdef VM
+		/* Zero a free frame ahead of time, with interrupts on, and let anyone
+		 * woken up meanwhile run before zeroing the next one. */
+		intr_enable ();
+		if (vm_zero_idle ())
+			continue;
+		intr_disable ();
+#endif
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -934,6 +958,7 @@ schedule (void) {
 	/* Activate the new address space. */
 	process_activate (next);
 #endif
+	fpu_switch (next);
 
 	if (curr != next) {
 		/* If the thread we switched from is dying, destroy its struct
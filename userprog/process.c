@@ -11,6 +11,7 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
@@ -140,7 +141,7 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 
 	/* Duplicate parent's page to the new page and check whether parent's
 	 * page is writable or not (set WRITABLE according to the result). */
-	memcpy (newpage, parent_page, PGSIZE);
+	fpu_page_copy (newpage, parent_page);
 	writable = is_writable (pte);
 
 	/* Add new page to child's page table at address VA with WRITABLE
@@ -185,6 +186,14 @@ __do_fork (void *aux) {
 		goto error;
 
 	process_activate (current);
+
+	/* Reopen parent's executable file and deny write on it. The pages copied
+	 * next are pages of it. */
+	current->executable = file_reopen (parent->executable);
+	if (current->executable == NULL)
+		goto error;
+	file_deny_write (current->executable);
+
 #ifdef VM
 	if (!supplemental_page_table_init (&current->spt)
 			|| !supplemental_page_table_copy (&current->spt, &parent->spt))
@@ -198,11 +207,9 @@ __do_fork (void *aux) {
 	if (!duplicate_fd_table (&parent->fd_t))
 		goto error;
 
-	/* Reopen parent's executable file and deny write on it. */
-	current->executable = file_reopen (parent->executable);
-	if (current->executable == NULL)
+	/* Duplicate parent's FPU registers. */
+	if (!fpu_copy (current, parent))
 		goto error;
-	file_deny_write (current->executable);
 
 	process_init ();
 
@@ -337,6 +344,8 @@ process_exec (void *command_) {
 
 	/* We first kill the current context */
 	process_cleanup (false);
+	/* The new program starts with the initial FPU registers. */
+	fpu_release (thread_current ());
 
 	/* And then load the binary */
 	success = load (command, &_if);
@@ -487,8 +496,12 @@ process_exit (int status) {
 		}
 		free (curr->fd_t.table);
 		if (!thread_tests) {
-			if (curr->executable)
+			if (curr->executable) {
 				file_close(curr->executable);
+				/* Its pages may still be found by other processes (see
+				 * vm_text_claim()) until destroyed. */
+				curr->executable = NULL;
+			}
 			else //Debugging purposes
 				ASSERT (status == -1);
 			/* Print exit status. */
@@ -974,14 +987,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-/* Structure used in lazy_load_segment and load_segment in order to fetch the
- * executable's data. */
-struct load_segment_aux {
-	struct file *file;	/* Source file (executable) for segment loading. */
-	off_t offset;				/* File's offset to read from. */
-	size_t read_bytes;	/* Number of bytes to read from FILE. */
-};
-
 static bool
 lazy_load_segment (struct page *page, void *aux_) {
 	void *kva;
@@ -1004,15 +1009,18 @@ lazy_load_segment (struct page *page, void *aux_) {
 	file = aux->file;
 	offset = aux->offset;
 	read_bytes = aux->read_bytes;
-	free (aux);
+	slab_free (&vm_seg_aux_slab, aux);
 	ASSERT (file);
 	ASSERT (((size_t)offset + read_bytes) <= (size_t)file_length (file));
 	ASSERT (read_bytes <= PGSIZE);
 
 	/* Read the data and fill the rest of the page with zeroes. */
-	if ((size_t)file_read_at (file, kva, read_bytes, offset) == read_bytes) {
-		if (read_bytes < PGSIZE)
+	if ((size_t)vm_file_read (file, kva, read_bytes, offset) == read_bytes) {
+		if (read_bytes < PGSIZE && !page->frame->zeroed)
 			memset (kva + read_bytes, 0, PGSIZE - read_bytes);
+		/* Let the page be read again from the executable instead of swapped. */
+		if (file == page->t->executable)
+			anon_exec_loaded (page, offset, read_bytes);
 		//printf("lazy_load_segment: success\n"); ////////////////////////////////////TEMPORAL: TESTING
 		return true;
 	}
@@ -1037,37 +1045,15 @@ lazy_load_segment (struct page *page, void *aux_) {
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes, bool writable) {
-	struct load_segment_aux *aux;
-
 	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	//printf("load_segment\n");/////////////////////////////////////////////////////TEMPORAL: TESTING
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		aux = (struct load_segment_aux*)malloc (sizeof (struct load_segment_aux));
-		if (!aux)
-			return false;
-		aux->file = file;
-		aux->offset = ofs;
-		aux->read_bytes = page_read_bytes;
-		if (!vm_alloc_page_with_initializer (VM_ANON | VM_ANON_EXEC, upage,
-					writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes;
-	}
-	return true;
+	/* The segment is a single area, whose pages are created and loaded by
+	 * lazy_load_segment() on their first access. */
+	return vm_alloc_area (VM_ANON | VM_ANON_EXEC, upage,
+			(read_bytes + zero_bytes) / PGSIZE, writable, lazy_load_segment, file,
+			ofs, read_bytes);
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
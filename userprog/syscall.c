@@ -50,6 +50,10 @@ static void syscall_close (int fd);
 static int syscall_dup2 (int oldfd, int newfd);
 static void *syscall_mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 static void syscall_munmap (void *addr);
+static int syscall_madvise (void *addr, size_t length, int advice);
+static int syscall_mlock (void *addr, size_t length, bool lock);
+static int syscall_msync (void *addr, size_t length);
+static void *syscall_range_end (void *addr, size_t length);
 static int create_file_descriptor (struct file *file);
 static void check_mem_space_read (const void *addr_, const size_t size, const bool is_str);
 static void check_mem_space_write (const void *addr_, const size_t size);
@@ -128,6 +132,19 @@ syscall_handler (struct intr_frame *f) {
 		case SYS_MUNMAP:		/* Remove a memory mapping. */
 			syscall_munmap ((void*)f->R.rdi);
 			break;
+		/* Extra for Project 3 */
+		case SYS_MADVISE:
+			f->R.rax = (uint64_t)syscall_madvise ((void*)f->R.rdi, (size_t)f->R.rsi, (int)f->R.rdx);
+			break;
+		case SYS_MLOCK:
+			f->R.rax = (uint64_t)syscall_mlock ((void*)f->R.rdi, (size_t)f->R.rsi, true);
+			break;
+		case SYS_MUNLOCK:
+			f->R.rax = (uint64_t)syscall_mlock ((void*)f->R.rdi, (size_t)f->R.rsi, false);
+			break;
+		case SYS_MSYNC:
+			f->R.rax = (uint64_t)syscall_msync ((void*)f->R.rdi, (size_t)f->R.rsi);
+			break;
 
 		/* Project 4 only. */
 		//case SYS_CHDIR:			/* Change the current directory. */
@@ -700,16 +717,64 @@ syscall_mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
  * has not yet been unmapped. */
 static void
 syscall_munmap (void *addr) {
-	struct page *page;
-
 	if (!vm_is_page_addr (addr))
 		return;
-	page = spt_find_page (&thread_current ()->spt, addr);
-	if (!page || VM_TYPE (page->operations->type) != VM_FILE)
-		return;
 	do_munmap (addr);
 }
 
+/* Advises the kernel on how the LENGTH bytes of memory starting at ADDR, which
+ * must be page aligned and mapped, will be used. ADVICE is one of the MADV_*
+ * values of <syscall-nr.h>. Returns 0 if successful, -1 otherwise. */
+static int
+syscall_madvise (void *addr, size_t length, int advice) {
+	void *end = syscall_range_end (addr, length);
+
+	if (!end || !vm_madvise (addr, end, advice))
+		return -1;
+	return 0;
+}
+
+/* Locks the pages holding the LENGTH bytes of memory starting at ADDR, which
+ * must be page aligned and mapped, in the main memory, loading them if needed,
+ * or unlocks them if LOCK is false. Returns 0 if successful, -1 otherwise. */
+static int
+syscall_mlock (void *addr, size_t length, bool lock) {
+	void *end = syscall_range_end (addr, length);
+
+	if (!end || !vm_mlock (addr, end, lock))
+		return -1;
+	return 0;
+}
+
+/* Writes back the modified pages of the file mappings in the LENGTH bytes of
+ * memory starting at ADDR, which must be page aligned and mapped.
+ * Returns 0 if successful, -1 otherwise. */
+static int
+syscall_msync (void *addr, size_t length) {
+	void *end = syscall_range_end (addr, length);
+
+	if (!end)
+		return -1;
+	vm_writeback_area (&thread_current ()->spt, addr, end);
+	return 0;
+}
+
+/* Returns the end of the pages holding the LENGTH bytes starting at ADDR, or a
+ * null pointer if ADDR is not page aligned, LENGTH is 0 or any such page is
+ * either not a user page or not mapped. */
+static void *
+syscall_range_end (void *addr, size_t length) {
+	void *end;
+
+	if (length == 0 || !vm_is_page_addr (addr) || !is_user_vaddr (addr))
+		return NULL;
+	end = pg_round_up ((uint8_t*)addr + length);
+	if (end <= addr || !is_user_vaddr ((uint8_t*)end - 1)
+			|| !vm_range_is_mapped (&thread_current ()->spt, addr, end))
+		return NULL;
+	return end;
+}
+
 
 /* Given the address ADDR of a memory space of size SIZE bytes, this
  * function checks if a memory violation occurs when trying to read from it.
@@ -770,9 +835,13 @@ check_mem_space_write (const void *addr_, const size_t size) {
 
 	if (addr == NULL)
 		thread_exit (-1);
-	/* Check the SIZE-bytes of memory starting at ADDR. */
+	/* Check the SIZE-bytes of memory starting at ADDR. Read-only pages must be
+	 * rejected before writing them, as write protection is enforced in kernel
+	 * mode too. */
 	for (size_t i = 0; i < size; i++) {
-		if (!valid_user_addr (addr) || !put_user (addr, 0))
+		if (!valid_user_addr (addr)
+				|| !spt_find_page (&thread_current ()->spt, addr)->writable
+				|| !put_user (addr, 0))
 			thread_exit (-1);
 		addr++;
 	}
@@ -1,11 +1,16 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include "threads/fpu.h"
 #include "threads/mmu.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "devices/disk.h"
-#include <hash.h>
-#include <bitmap.h>
+#include "filesys/file.h"
+#include "vm/zswap.h"
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
 #include <stdio.h>//////////////////////////////////////////////////////////////TEMPORAL
 
 /* Number of disk sectors that make up a page. */
@@ -16,8 +21,6 @@ static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
-static hash_hash_func swap_hash_func;
-static hash_less_func swap_less_func;
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -27,52 +30,161 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Number of slots tracked by each word of the swap table's bitmaps. */
+#define SLOT_BITS 64
+
+/* Swap table. A page holding a swap slot stores its index in its anon_page,
+ * and the free slots are tracked by a two-level bitmap: Bit I of USED[W] is
+ * set if slot W * SLOT_BITS + I is in use, and bit J of FULL[K] is set if all
+ * bits of USED[K * SLOT_BITS + J] are set. Hence, a free slot is found by
+ * looking at a couple of words, starting from HINT.
+ * Pages are swapped in and out without the frame table lock, so the table has
+ * a lock of its own, which also protects the anon_pages' swap slots and the
+ * compressed swap cache. Disk I/O is done without it. */
 static struct swap_table {
+	struct lock lock;				/* Serializes slot allocation and release. */
 	size_t size;						/* Number of pages in the swap_disk. */
-	struct bitmap *bitmap;	/* Bitmap that specifies if a swap memory slot is free
-													 * or not. The index in the map is the one of the page
-													 * in the swap memory. */
-	struct hash table;			/* Table that maps a page into its swap slot. */
+	uint64_t *used;					/* Bitmap of used slots. */
+	size_t used_words;			/* Number of words in USED. */
+	uint64_t *full;					/* Bitmap of words of USED with no free slot. */
+	size_t full_words;			/* Number of words in FULL. */
+	size_t hint;						/* No word of FULL before this one has a clear
+													 * bit. */
+	unsigned *refs;					/* Number of pages sharing each swap slot. */
+	size_t holders;					/* Number of pages holding a swap slot. */
 } swap_t;
 
-/* Checks and asserts if the swap_table "swap_t" is correct. */
+#ifdef SWAP_DEBUG
+/* Checks and asserts if the swap_table "swap_t" is correct.
+ * Takes time proportional to the size of the swap disk, so it is only done if
+ * SWAP_DEBUG is defined (e.g. by adding -DSWAP_DEBUG to DEFINES in
+ * vm/Make.vars). */
 static void
 swap_check_table (void) {
-	ASSERT (
-		bitmap_count (swap_t.bitmap, 0, swap_t.size, true)
-				== hash_size (&swap_t.table));//////////////////////////////////////////May have synchronization issues
+	size_t refs = 0;
+	bool used, full;
+
+	for (size_t i = 0; i < swap_t.size; i++) {
+		used = (swap_t.used[i / SLOT_BITS] >> (i % SLOT_BITS)) & 1;
+		ASSERT ((swap_t.refs[i] != 0) == used);
+		refs += swap_t.refs[i];
+	}
+	for (size_t w = 0; w < swap_t.used_words; w++) {
+		full = (swap_t.full[w / SLOT_BITS] >> (w % SLOT_BITS)) & 1;
+		ASSERT ((swap_t.used[w] == UINT64_MAX) == full);
+		ASSERT (w / SLOT_BITS >= swap_t.hint || full);
+	}
+	ASSERT (refs == swap_t.holders);
 }
+#else
+#define swap_check_table() ((void) 0)
+#endif
 
-/* Hash function for a swap_table page holding a swap_elem E. */
-static uint64_t
-swap_hash_func (const struct hash_elem *e, void *aux UNUSED) {
-	struct page *page;
+/* Takes a free swap slot and returns its index, or SWAP_NONE if there is
+ * none. The slot has no references yet. */
+static size_t
+swap_slot_alloc (void) {
+	size_t k, w, i;
 
-	ASSERT (e);
+	for (k = swap_t.hint; k < swap_t.full_words; k++)
+		if (swap_t.full[k] != UINT64_MAX)
+			break;
+	swap_t.hint = k;
+	if (k == swap_t.full_words)
+		return SWAP_NONE;
 
-	page = hash_entry (e, struct anon_page, swap_elem)->page;
-	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
-	ASSERT (vm_is_page_addr (page->va)); /////////////////////////////////////////Debugging purposes: May be incorrect
-	return hash_bytes (&page, sizeof (page));
+	w = k * SLOT_BITS + __builtin_ctzll (~swap_t.full[k]);
+	ASSERT (w < swap_t.used_words && swap_t.used[w] != UINT64_MAX);
+	i = __builtin_ctzll (~swap_t.used[w]);
+	swap_t.used[w] |= (uint64_t) 1 << i;
+	if (swap_t.used[w] == UINT64_MAX)
+		swap_t.full[k] |= (uint64_t) 1 << (w % SLOT_BITS);
+	ASSERT (w * SLOT_BITS + i < swap_t.size);
+	ASSERT (swap_t.refs[w * SLOT_BITS + i] == 0);
+	return w * SLOT_BITS + i;
 }
 
-/* Default function for comparison between two hash elements A and B that belong
- * to a swap_table entry (page).
- * Returns TRUE if A belongs to a page whose address value is less than B's. */
+/* Takes the swap slot IDX, if free. Returns true if successful. */
 static bool
-swap_less_func (const struct hash_elem *a, const struct hash_elem *b,
-		void *aux UNUSED) {
-	struct page *a_page, *b_page;
+swap_slot_take (size_t idx) {
+	size_t w = idx / SLOT_BITS;
+	uint64_t bit = (uint64_t) 1 << (idx % SLOT_BITS);
+
+	ASSERT (idx < swap_t.size);
+
+	if (swap_t.used[w] & bit)
+		return false;
+	ASSERT (swap_t.refs[idx] == 0);
+	swap_t.used[w] |= bit;
+	if (swap_t.used[w] == UINT64_MAX)
+		swap_t.full[w / SLOT_BITS] |= (uint64_t) 1 << (w % SLOT_BITS);
+	return true;
+}
+
+/* Returns the page at VA in the address space of PAGE's owner, if it is an
+ * anonymous page holding a swap slot, or NULL. */
+static struct page *
+swap_neighbour (struct page *page, void *va) {
+	struct page *nb = spt_lookup_page (&page->t->spt, va);
+
+	if (nb && VM_TYPE (nb->operations->type) == VM_ANON
+			&& nb->anon.idx != SWAP_NONE)
+		return nb;
+	return NULL;
+}
+
+/* Takes a free swap slot for PAGE and returns its index, or SWAP_NONE if there
+ * is none. Prefers the slot right after the one of the previous page in the
+ * address space of PAGE's owner, or right before the one of the next page,
+ * so that swap-in read-ahead finds them contiguous.
+ * The neighbours are only looked up if PAGE belongs to the current thread:
+ * Another thread could walk the owner's spt while the owner destroys it or
+ * frees its pages, which the swap table lock does not prevent. */
+static size_t
+swap_slot_alloc_near (struct page *page) {
+	struct page *nb;
+
+	if (page->t != thread_current ())
+		return swap_slot_alloc ();
+	nb = swap_neighbour (page, page->va - PGSIZE);
+	if (nb && nb->anon.idx + 1 < swap_t.size && swap_slot_take (nb->anon.idx + 1))
+		return nb->anon.idx + 1;
+	nb = swap_neighbour (page, page->va + PGSIZE);
+	if (nb && nb->anon.idx > 0 && swap_slot_take (nb->anon.idx - 1))
+		return nb->anon.idx - 1;
+	return swap_slot_alloc ();
+}
+
+/* Makes ANON_PAGE hold a new reference to the swap slot IDX. */
+static void
+swap_slot_get (struct anon_page *anon_page, size_t idx) {
+	ASSERT (anon_page->idx == SWAP_NONE);
+	ASSERT (idx < swap_t.size);
 
-	ASSERT (a && b);
+	anon_page->idx = idx;
+	swap_t.refs[idx]++;
+	swap_t.holders++;
+}
+
+/* Drops ANON_PAGE's reference to its swap slot, which becomes free once no
+ * page shares it. */
+static void
+swap_slot_release (struct anon_page *anon_page) {
+	size_t idx = anon_page->idx, w = idx / SLOT_BITS;
+
+	ASSERT (idx < swap_t.size);
+	ASSERT ((swap_t.used[w] >> (idx % SLOT_BITS)) & 1);
+	ASSERT (swap_t.refs[idx] > 0 && swap_t.holders > 0);
 
-	a_page = hash_entry (a, struct anon_page, swap_elem)->page;
-	b_page = hash_entry (b, struct anon_page, swap_elem)->page;
-	ASSERT (VM_TYPE (a_page->operations->type) == VM_ANON);
-	ASSERT (VM_TYPE (b_page->operations->type) == VM_ANON);
-	ASSERT (vm_is_page_addr (a_page->va)); //////////////////////////////////////////Debugging purposes: May be incorrect
-	ASSERT (vm_is_page_addr (b_page->va)); //////////////////////////////////////////Debugging purposes: May be incorrect
-	return a_page < b_page;
+	anon_page->idx = SWAP_NONE;
+	swap_t.holders--;
+	if (--swap_t.refs[idx] == 0) {
+		zswap_invalidate (idx);
+		swap_t.used[w] &= ~((uint64_t) 1 << (idx % SLOT_BITS));
+		swap_t.full[w / SLOT_BITS] &= ~((uint64_t) 1 << (w % SLOT_BITS));
+		if (w / SLOT_BITS < swap_t.hint)
+			swap_t.hint = w / SLOT_BITS;
+	}
 }
 
 /* Maps the index of swap memory slot into the corresponding swap_disk sector. */
@@ -82,20 +194,50 @@ index_to_sector (size_t idx) {
 	return (disk_sector_t)(idx * SECTORS_PER_PAGE);
 }
 
+/* Writes the page at KVA to the swap slot IDX, in the compressed swap cache if
+ * it takes it, or else on the swap disk.
+ * The swap table lock must be held, and is released on return. */
+static void
+swap_write (size_t idx, const void *kva) {
+	bool cached;
+
+	ASSERT (lock_held_by_current_thread (&swap_t.lock));
+
+	cached = zswap_store (idx, kva);
+	lock_release (&swap_t.lock);
+	if (!cached)
+		disk_write_multiple (swap_disk, index_to_sector (idx), kva,
+				SECTORS_PER_PAGE);
+}
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
+	size_t w;
+
 	/* Set up the swap_disk. */
 	swap_disk = disk_get (1, 1);
 	if (!swap_disk)
 		PANIC ("Unable to get swap disk");
 	/* Set up the swap table. */
+	lock_init (&swap_t.lock);
 	swap_t.size = disk_size (swap_disk) / SECTORS_PER_PAGE;
 	if (swap_t.size == 0)
 		PANIC ("The swap disk is too small to store a page");
-	if (!((swap_t.bitmap = bitmap_create (swap_t.size))
-			&& hash_init (&swap_t.table, swap_hash_func, swap_less_func, NULL)))
+	swap_t.used_words = DIV_ROUND_UP (swap_t.size, SLOT_BITS);
+	swap_t.full_words = DIV_ROUND_UP (swap_t.used_words, SLOT_BITS);
+	if (!((swap_t.used = calloc (swap_t.used_words, sizeof *swap_t.used))
+			&& (swap_t.full = calloc (swap_t.full_words, sizeof *swap_t.full))
+			&& (swap_t.refs = calloc (swap_t.size, sizeof *swap_t.refs))))
 		PANIC ("Unable to create swap table");
+	/* The bits past the end of each bitmap are never free. */
+	if (swap_t.size % SLOT_BITS)
+		swap_t.used[swap_t.used_words - 1] = UINT64_MAX << (swap_t.size % SLOT_BITS);
+	for (w = swap_t.used_words; w < swap_t.full_words * SLOT_BITS; w++)
+		swap_t.full[w / SLOT_BITS] |= (uint64_t) 1 << (w % SLOT_BITS);
+	swap_t.hint = 0;
+	swap_t.holders = 0;
+	zswap_init (swap_t.size);
 }
 
 /* Initialize the file mapping */
@@ -109,24 +251,101 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 	page->anon.page = page;
+	page->anon.exec_clean = false;
+	page->anon.idx = SWAP_NONE;
 	switch (VM_SUBTYPE (type)) {
 		case VM_ANON_STACK:
 			page->anon.a_type = ANON_STACK;
+			/* Stack pages start zeroed. */
+			if (!page->frame->zeroed)
+				fpu_page_zero (kva);
 			break;
 		case VM_ANON_EXEC:
 			page->anon.a_type = ANON_EXEC;
 			break;
+		case 0:
+			/* Filled by whoever creates the page. */
+			page->anon.a_type = ANON_PLAIN;
+			break;
 		default:////////////////////////////////////////////////////////////////////May need to be updated on addition of more anon types
 			PANIC ("Unrecognized anon page type");
 	}
 	return true;
 }
 
+/* Records that the ANON_EXEC page PAGE has just been loaded with READ_BYTES
+ * bytes of its owner's executable at offset OFS, and zeroes. As long as it is
+ * not modified, it is dropped on eviction and loaded again from the
+ * executable, instead of using the swap disk. */
+void
+anon_exec_loaded (struct page *page, off_t ofs, size_t read_bytes) {
+	ASSERT (page && page->frame);
+	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
+	ASSERT (page->anon.a_type == ANON_EXEC);
+	ASSERT (page->t->executable && read_bytes <= PGSIZE);
+
+	page->anon.exec_clean = true;
+	page->anon.exec_ofs = ofs;
+	page->anon.exec_bytes = read_bytes;
+}
+
+/* Turns DST into an anonymous page that shares the contents of the anonymous
+ * page SRC, which must belong to another process. If SRC has been swapped
+ * out, both pages share its swap slot; otherwise the caller must share SRC's
+ * frame with DST. */
+void
+anon_share (struct page *dst, struct page *src) {
+	struct anon_page *anon_page;
+
+	ASSERT (dst && src && dst->t != src->t);
+	ASSERT (VM_TYPE (dst->operations->type) == VM_UNINIT && !dst->frame);
+	ASSERT (VM_TYPE (src->operations->type) == VM_ANON);
+
+	/* Set up the handler */
+	dst->operations = &anon_ops;
+	anon_page = &dst->anon;
+	anon_page->page = dst;
+	anon_page->a_type = src->anon.a_type;
+	anon_page->idx = SWAP_NONE;
+	if (src->frame)
+		anon_share_frame (src);
+	anon_page->exec_clean = src->anon.exec_clean;
+	anon_page->exec_ofs = src->anon.exec_ofs;
+	anon_page->exec_bytes = src->anon.exec_bytes;
+	if (!src->frame && !src->anon.exec_clean) {
+		lock_acquire (&swap_t.lock);
+		swap_check_table ();
+		swap_slot_get (anon_page, src->anon.idx);
+		lock_release (&swap_t.lock);
+	}
+}
+
+/* Prepares the anonymous page PAGE, which is in the main memory, to share its
+ * frame with other pages.
+ * The frame table lock must be held. */
+void
+anon_share_frame (struct page *page) {
+	ASSERT (page && page->frame);
+	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
+
+	/* The frame may have been modified through PAGE before being shared. */
+	if (page->anon.exec_clean && pml4_is_dirty (page->t->pml4, page->va))
+		page->anon.exec_clean = false;
+	/* Drop the swap slot written back by the writeback daemon, if any, so that
+	 * the pages sharing the frame hold none until evicted. */
+	if (page->anon.idx != SWAP_NONE) {
+		lock_acquire (&swap_t.lock);
+		swap_slot_release (&page->anon);
+		lock_release (&swap_t.lock);
+	}
+}
+
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page;
 	disk_sector_t sector;
+	bool cached;
 
 	ASSERT (page);
 	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
@@ -136,26 +355,47 @@ anon_swap_in (struct page *page, void *kva) {
 	ASSERT (thread_is_user (page->t)
 			&& spt_find_page (&page->t->spt, page->va) == page
 			&& pml4_get_page (page->t->pml4, page->va) == kva);
-	ASSERT (hash_find (&swap_t.table, &anon_page->swap_elem));
-	ASSERT (bitmap_test (swap_t.bitmap, anon_page->idx));
+
+	if (anon_page->idx == SWAP_NONE) {
+		/* Read from the executable. */
+		ASSERT (anon_page->exec_clean && page->t->executable);
+		if ((size_t)file_read_at (page->t->executable, kva,
+				anon_page->exec_bytes, anon_page->exec_ofs) != anon_page->exec_bytes)
+			return false;
+		if (!page->frame->zeroed)
+			memset (kva + anon_page->exec_bytes, 0, PGSIZE - anon_page->exec_bytes);
+		return true;
+	}
+	/* Read from the compressed swap cache, or else from disk. */
+	lock_acquire (&swap_t.lock);
 	swap_check_table ();
-	
-	/* Read from disk. */
-	sector = index_to_sector (anon_page->idx);
-	for (unsigned i = 0; i < SECTORS_PER_PAGE; i++)
-		disk_read (swap_disk, sector + i, kva + i * DISK_SECTOR_SIZE);
-	/* Allow usage of swap slot. */
-	ASSERT (hash_delete (&swap_t.table, &anon_page->swap_elem));
-	bitmap_set (swap_t.bitmap, anon_page->idx, false);
+	cached = zswap_load (anon_page->idx, kva);
+	lock_release (&swap_t.lock);
+	if (!cached) {
+		sector = index_to_sector (anon_page->idx);
+		disk_read_multiple (swap_disk, sector, kva, SECTORS_PER_PAGE);
+	}
+	/* Allow usage of swap slot, once no other page shares it. */
+	lock_acquire (&swap_t.lock);
+	swap_slot_release (anon_page);
+	lock_release (&swap_t.lock);
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * The page must have already been unmapped from its owner's pml4. If another
+ * page sharing its frame has already been swapped out, their swap slot is
+ * shared as well. If the page has been written back by anon_writeback(), it
+ * is only written again if modified since.
+ * Called without the frame table lock, while the frame is pinned and its I/O
+ * in progress (see vm_evict()). */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page;
+	struct list_elem *e;
+	struct page *sharer;
+	size_t idx;
 	void *kva;
-	disk_sector_t sector;
 
 	ASSERT (page && page->frame);
 	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
@@ -165,22 +405,83 @@ anon_swap_out (struct page *page) {
 	ASSERT (anon_page->page == page);
 	ASSERT (thread_is_user (page->t)
 			&& spt_find_page (&page->t->spt, page->va) == page
-			&& pml4_get_page (page->t->pml4, page->va) == kva);
-	swap_check_table ();
+			&& !pml4_get_page (page->t->pml4, page->va));
 
-	if (!hash_find (&swap_t.table, &anon_page->swap_elem)) {
+	/* Clean pages loaded from the executable are just dropped. */
+	if (anon_page->exec_clean) {
+		if (!pml4_is_dirty (page->t->pml4, page->va))
+			return true;
+		anon_page->exec_clean = false;
+	}
+	lock_acquire (&swap_t.lock);
+	swap_check_table ();
+	if (anon_page->idx != SWAP_NONE) {
+		ASSERT (page->frame->ref_cnt == 1 && swap_t.refs[anon_page->idx] == 1);
+		if (pml4_is_dirty (page->t->pml4, page->va))
+			swap_write (anon_page->idx, kva);
+		else
+			lock_release (&swap_t.lock);
+		return true;
+	} else {
+		for (e = list_begin (&page->frame->pages);
+				e != list_end (&page->frame->pages); e = list_next (e)) {
+			sharer = list_entry (e, struct page, f_elem);
+			ASSERT (VM_TYPE (sharer->operations->type) == VM_ANON);
+			if (sharer != page && sharer->anon.idx != SWAP_NONE) {
+				swap_slot_get (anon_page, sharer->anon.idx);
+				lock_release (&swap_t.lock);
+				return true;
+			}
+		}
 		/* Obtain a table entry to store the data. */
-		anon_page->idx = bitmap_scan_and_flip (swap_t.bitmap, 0, 1, false); ////////May have synchronization issues
-		if (anon_page->idx == BITMAP_ERROR)
+		idx = swap_slot_alloc_near (page);
+		if (idx == SWAP_NONE)
 			PANIC ("Not enough space in the swap memory to store page");
-		ASSERT (!hash_insert (&swap_t.table, &anon_page->swap_elem));
+		swap_slot_get (anon_page, idx);
 		/* Copy the page into the swap memory. */
-		sector = index_to_sector (anon_page->idx);
-		for (unsigned i = 0; i < SECTORS_PER_PAGE; i++)
-			disk_write (swap_disk, sector + i, kva + i * DISK_SECTOR_SIZE);
+		swap_write (anon_page->idx, kva);
 		return true;
 	}
-	return false;
+}
+
+/* Writes the contents of PAGE, which must be in the main memory and not share
+ * its frame, to the swap disk, so that it can be later evicted without any
+ * I/O unless modified meanwhile. PAGE keeps its swap slot, if it already had
+ * one, until it is swapped in or destroyed.
+ * Returns false if there is no swap slot left.
+ * Called without the frame table lock, once the caller has cleared the page's
+ * dirty bit, so that writes made during the I/O are not lost, and while the
+ * frame is pinned and its I/O in progress (see vm_writeback_page()). */
+bool
+anon_writeback (struct page *page) {
+	struct anon_page *anon_page;
+	size_t idx;
+
+	ASSERT (page && page->frame && page->frame->ref_cnt == 1);
+	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
+	ASSERT (pml4_get_page (page->t->pml4, page->va) == page->frame->kva);
+	anon_page = &page->anon;
+	ASSERT (anon_page->page == page);
+
+	lock_acquire (&swap_t.lock);
+	swap_check_table ();
+	if (anon_page->idx == SWAP_NONE) {
+		idx = swap_slot_alloc_near (page);
+		if (idx == SWAP_NONE) {
+			lock_release (&swap_t.lock);
+			return false;
+		}
+		swap_slot_get (anon_page, idx);
+	}
+	/* The page is still mapped, so it is not worth keeping a compressed copy:
+	 * It goes to disk, replacing any copy of the slot in the cache. */
+	zswap_invalidate (anon_page->idx);
+	lock_release (&swap_t.lock);
+	/* The page no longer matches the executable, if loaded from it. */
+	anon_page->exec_clean = false;
+	disk_write_multiple (swap_disk, index_to_sector (anon_page->idx),
+			page->frame->kva, SECTORS_PER_PAGE);
+	return true;
 }
 
 /* Destroy the anonymous page, which must NOT be in the current thread's spt.
@@ -196,20 +497,19 @@ anon_destroy (struct page *page) {
 	ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
 	anon_page = &page->anon;
 	ASSERT (anon_page->page == page);
-	swap_check_table ();
 
-	if (pml4_get_page (page->t->pml4, page->va)) {
-		/* The page is in the main memory. */
-		struct frame *frame = page->frame;
-		ASSERT (frame && frame->page == page);
-		ASSERT (!hash_find (&swap_t.table, &anon_page->swap_elem));
-		pml4_clear_page (page->t->pml4, page->va);
-		palloc_free_page (frame->kva);
-		free (frame);
-	} else { /* The page has been swapped. */
-		ASSERT (bitmap_test (swap_t.bitmap, anon_page->idx));
+	lock_acquire (&swap_t.lock);
+	swap_check_table ();
+	if (page->frame) {
+		/* The page is in the main memory, maybe sharing its frame and holding
+		 * the swap slot it was written back to. */
+		if (anon_page->idx != SWAP_NONE)
+			swap_slot_release (anon_page);
+	} else if (!anon_page->exec_clean) { /* The page has been swapped. */
 		/* Remove from swap table. */
-		ASSERT (hash_delete (&swap_t.table, &anon_page->swap_elem));
-		bitmap_reset (swap_t.bitmap, anon_page->idx);
+		swap_slot_release (anon_page);
 	}
+	lock_release (&swap_t.lock);
+	if (page->frame)
+		vm_release_frame (page);
 }
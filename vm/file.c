@@ -2,11 +2,12 @@
 
 #include "vm/vm.h"
 #include "filesys/file.h"
-#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
+#include "threads/synch.h"
 #include <string.h>
 #include <hash.h>
+#include <round.h>
 
 static hash_hash_func m_hash_func;
 static hash_less_func m_less_func;
@@ -15,8 +16,10 @@ static bool file_map_swap_out (struct page *page);
 static void file_map_destroy (struct page *page);
 
 /* Keeps track of swapped in/out mapped pages by holding those that are not
- * currently mapped. */
+ * currently mapped. Pages are swapped in and out without the frame table
+ * lock, so the table has a lock of its own. */
 static struct hash um_table;
+static struct lock um_lock;
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -58,9 +61,37 @@ m_less_func (const struct hash_elem *a, const struct hash_elem *b,
 	return a_page < b_page;
 }
 
+/* Adds FILE_PAGE, which must not be there, to um_table. */
+static void
+um_insert (struct file_page *file_page) {
+	lock_acquire (&um_lock);
+	ASSERT (!hash_insert (&um_table, &file_page->um_elem));
+	lock_release (&um_lock);
+}
+
+/* Removes FILE_PAGE, which must be there, from um_table. */
+static void
+um_delete (struct file_page *file_page) {
+	lock_acquire (&um_lock);
+	ASSERT (hash_delete (&um_table, &file_page->um_elem));
+	lock_release (&um_lock);
+}
+
+/* Returns true if FILE_PAGE is in um_table. */
+static bool
+um_contains (struct file_page *file_page) {
+	bool found;
+
+	lock_acquire (&um_lock);
+	found = hash_find (&um_table, &file_page->um_elem) != NULL;
+	lock_release (&um_lock);
+	return found;
+}
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&um_lock);
 	if (!hash_init (&um_table, m_hash_func, m_less_func, NULL))
 		PANIC ("Unable to initialize file vm");
 }
@@ -86,8 +117,8 @@ file_map_initializer (struct page *page, enum vm_type type, void *kva) {
 	file_page->file = aux->file;
 	file_page->offset = aux->offset;
 	file_page->length = aux->length;
-	free (aux);
-	ASSERT (!hash_insert (&um_table, &file_page->um_elem));
+	slab_free (&vm_file_aux_slab, aux);
+	um_insert (file_page);
 	return file_map_swap_in (page, kva);
 }
 
@@ -106,7 +137,7 @@ file_map_swap_in (struct page *page, void *kva) {
 			&& spt_find_page (&page->t->spt, page->va) == page
 			&& pml4_get_page (page->t->pml4, page->va) == kva);
 	file_page = &page->file;
-	ASSERT (hash_find (&um_table, &file_page->um_elem));
+	ASSERT (um_contains (file_page));
 	file = file_page->file;
 	offset = file_page->offset;
 	length = file_page->length;
@@ -115,15 +146,18 @@ file_map_swap_in (struct page *page, void *kva) {
 	ASSERT (((size_t)offset + length) <= (size_t)file_length (file));/////////////May not be correct
 
 	/* Read the data and fill the rest of the page with zeroes. */
-	ASSERT ((size_t)file_read_at (file, kva, length, offset) == length);
-	if (length < PGSIZE)
+	ASSERT ((size_t)vm_file_read (file, kva, length, offset) == length);
+	if (length < PGSIZE && !page->frame->zeroed)
 		memset (kva + length, 0, PGSIZE - length);
 	/* Remove from unmapped table. */
-	ASSERT (hash_delete (&um_table, &file_page->um_elem));
+	um_delete (file_page);
 	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.
+ * The page must have already been unmapped from its owner's pml4.
+ * Called without the frame table lock, while the frame is pinned and its I/O
+ * in progress (see vm_evict()). */
 static bool
 file_map_swap_out (struct page *page) {
 	struct file_page *file_page;
@@ -138,9 +172,9 @@ file_map_swap_out (struct page *page) {
 	ASSERT (vm_is_page_addr (kva)); //////////////////////////////////////////////Debugging purposes: May be incorrect
 	ASSERT (thread_is_user (page->t)
 			&& spt_find_page (&page->t->spt, page->va) == page
-			&& pml4_get_page (page->t->pml4, page->va) == kva);
-			file_page = &page->file;
-	ASSERT (!hash_find (&um_table, &file_page->um_elem));
+			&& !pml4_get_page (page->t->pml4, page->va));
+	file_page = &page->file;
+	ASSERT (!um_contains (file_page));
 
 	file = file_page->file;
 	offset = file_page->offset;
@@ -149,12 +183,63 @@ file_map_swap_out (struct page *page) {
 	ASSERT (length > 0 && length <= PGSIZE);
 	ASSERT (((size_t)offset + length) <= (size_t)file_length (file));/////////////May not be correct
 
-	ASSERT ((size_t)file_write_at (file, kva, length, offset) == length);
-	ASSERT (!hash_insert (&um_table, &file_page->um_elem));
+	/* Clean pages need no writeback. */
+	if (pml4_is_dirty (page->t->pml4, page->va)) {
+		ASSERT ((size_t)file_write_at (file, kva, length, offset) == length);
+	}
+	um_insert (file_page);
 	return true;
 }
 
+/* Writes the contents of PAGE, which must be in the main memory, back to its
+ * file, so that it can be later evicted without any I/O unless modified again.
+ * Called without the frame table lock, once the caller has cleared the page's
+ * dirty bit, so that writes made during the I/O are not lost, and while the
+ * frame is pinned and its I/O in progress (see vm_writeback_page()). */
+bool
+file_map_writeback (struct page *page) {
+	struct file_page *file_page;
+
+	ASSERT (page && page->frame);
+	ASSERT (VM_TYPE (page->operations->type) == VM_FILE);
+	ASSERT (pml4_get_page (page->t->pml4, page->va) == page->frame->kva);
+	file_page = &page->file;
+	ASSERT (file_page->file && file_page->length <= PGSIZE);
+	ASSERT (!um_contains (file_page));
+
+	ASSERT ((size_t)file_write_at (file_page->file, page->frame->kva,
+			file_page->length, file_page->offset) == file_page->length);
+	return true;
+}
+
+/* Writes back the contents of the CNT pages in RUN, which must be modified,
+ * in the main memory, and follow each other in the same file, with a single
+ * write through BUF, a buffer of at least CNT pages.
+ * Called without the frame table lock, under the same conditions as
+ * file_map_writeback(). */
+void
+file_map_writeback_run (struct page *run[], size_t cnt, uint8_t *buf) {
+	struct file_page *file_page;
+	size_t length = 0, i;
+
+	ASSERT (cnt > 0);
+
+	for (i = 0; i < cnt; i++) {
+		ASSERT (run[i]->frame);
+		ASSERT (VM_TYPE (run[i]->operations->type) == VM_FILE);
+		file_page = &run[i]->file;
+		ASSERT (file_page->file == run[0]->file.file);
+		ASSERT (file_page->offset == run[0]->file.offset + (off_t)length);
+		memcpy (buf + length, run[i]->frame->kva, file_page->length);
+		length += file_page->length;
+	}
+	file_page = &run[0]->file;
+	ASSERT ((size_t)file_write_at (file_page->file, buf, length,
+			file_page->offset) == length);
+}
+
 /* Destory the file mapped page, which must NOT be in the current thread's spt.
+ * The file is borrowed from the page's area, so it is not closed.
  * PAGE will be freed by the caller. */
 static void
 file_map_destroy (struct page *page) {
@@ -176,68 +261,105 @@ file_map_destroy (struct page *page) {
 	ASSERT (file);
 	ASSERT (length <= PGSIZE);
 	ASSERT (((size_t)offset + length) <= (size_t)file_length (file));/////////////May not be correct
-	/* Writeback all the modified contents to the storage, if on main memory. */
-	if (pml4_get_page (page->t->pml4, page->va)) {
-		ASSERT (page->frame);
+	/* Writeback all the modified contents to the storage, if on main memory.
+	 * They have usually been written back already, without the frame table
+	 * lock (see spt_page_destructor()). */
+	if (page->frame) {
 		kva = page->frame->kva;
 		ASSERT (vm_is_page_addr (kva)
 				&& pml4_get_page (page->t->pml4, page->va) == kva);
-		ASSERT (!hash_find (&um_table, &file_page->um_elem));
-		ASSERT ((size_t)file_write_at (file, kva, length, offset) == length);
-		pml4_clear_page (page->t->pml4, page->va);
-		palloc_free_page (kva);
-		free (page->frame);
+		ASSERT (!um_contains (file_page));
+		if (pml4_is_dirty (page->t->pml4, page->va)) {
+			ASSERT ((size_t)file_write_at (file, kva, length, offset) == length);
+		}
+		vm_release_frame (page);
 	} else
-		ASSERT (hash_delete (&um_table, &file_page->um_elem));
-	file_close (file_page->file);
+		um_delete (file_page);
 }
 
-/* Do the mmap */
+/* Creates in the current thread's spt a page that maps the same file contents
+ * as PARENT, a file mapped page (initialized or not) of another process.
+ * Mapped pages are not shared between processes: If PARENT is in the main
+ * memory, its modified contents must have been written back (see
+ * spt_copy_page()), so that the new page reads them when it is first accessed.
+ * The new page reads and writes the same contents through FILE, the file of
+ * the current thread's copy of PARENT's area, which it borrows.
+ * The frame table lock must be held, so that PARENT is not evicted meanwhile. */
+bool
+file_map_copy (struct page *parent, struct file *file) {
+	struct file_page *src, *aux;
+
+	ASSERT (parent && vm_is_page_addr (parent->va));
+	ASSERT (parent->t != thread_current ());
+
+	if (VM_TYPE (parent->operations->type) == VM_UNINIT) {
+		ASSERT (VM_TYPE (parent->uninit.type) == VM_FILE);
+		src = (struct file_page*)parent->uninit.aux;
+	} else {
+		ASSERT (VM_TYPE (parent->operations->type) == VM_FILE);
+		src = &parent->file;
+		ASSERT (!parent->frame || !pml4_is_dirty (parent->t->pml4, parent->va));
+	}
+	ASSERT (src && src->file && file);
+
+	/* Set up aux data and page. */
+	aux = (struct file_page*)slab_alloc (&vm_file_aux_slab);
+	if (!aux)
+		return false;
+	aux->file = file;
+	aux->offset = src->offset;
+	aux->length = src->length;
+	if (!vm_alloc_page_with_initializer (VM_FILE, parent->va, parent->writable,
+			NULL, aux)) {
+		slab_free (&vm_file_aux_slab, aux);
+		return false;
+	}
+	return true;
+}
+
+/* Do the mmap. The mapping is a single area of the address space, whose
+ * pages are only created when first accessed. */
 void *
 do_mmap (void *addr, size_t length, int writable, struct file *file,
 		off_t offset) {
-	struct file_page *m_elem;
-	size_t page_cnt, read_bytes;
-	void *uaddr = addr;
+	size_t read_bytes = 0;
 
 	ASSERT (vm_is_page_addr (addr) && length && file);
 	ASSERT (file_length (file) > 0);
 
-	page_cnt = (length % PGSIZE)? 1 + length / PGSIZE: length / PGSIZE;
-	if (((size_t)offset + length) > (size_t)file_length (file))
-		length = (size_t)(file_length (file) - offset);
-	for (size_t i = 0; i < page_cnt; i++) {
-		if (i != 0) {
-			/* Make sure that FILE is not destroyed until all pages are removed. */
-			ASSERT (file_dup2 (file));
-		}
-		/* Set up aux data and page. */
-		m_elem = (struct file_page*)malloc (sizeof (struct file_page));
-		if (m_elem) {
-			m_elem->file = file;
-			m_elem->offset = offset;
-			m_elem->length = (length > PGSIZE)? PGSIZE: length;
-			if (vm_alloc_page_with_initializer (VM_FILE, uaddr, writable, NULL, m_elem)) {
-				uaddr += PGSIZE;
-				offset += PGSIZE;
-				length -= m_elem->length;
-				continue;
-			}
-			free (m_elem);
-		}
+	if (offset < file_length (file))
+		read_bytes = ((size_t)(file_length (file) - offset) < length)?
+				(size_t)(file_length (file) - offset): length;
+	if (!vm_alloc_area (VM_FILE, addr, DIV_ROUND_UP (length, PGSIZE), writable,
+			NULL, file, offset, read_bytes)) {
 		file_close (file);
 		return NULL;
 	}
-	ASSERT (length == 0);
 	return addr;
 }
 
-/* Do the munmap */
+/* Do the munmap. ADDR must be the start of a file mapping of the current
+ * thread, otherwise nothing is done. */
 void
 do_munmap (void *addr) {
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+	struct page *page;
+	void *va;
 
 	ASSERT (vm_is_page_addr (addr));
 
-	spt_remove_page (spt, spt_find_page (spt, addr));
+	vma = vma_find (&spt->vmas, addr);
+	if (!vma || vma->start != addr || vma->type != VM_FILE)
+		return;
+	/* Remove the area first, so that looking its pages up does not create
+	 * them, and write back its modified pages by runs before destroying them.
+	 * The pages borrow the area's file, which is closed once they are gone. */
+	vma_remove (&spt->vmas, vma);
+	vm_writeback_area (spt, vma->start, vma->end);
+	for (va = vma->start; va < vma->end; va += PGSIZE)
+		if ((page = spt_lookup_page (spt, va)))
+			spt_remove_page (spt, page);
+	file_close (vma->file);
+	slab_free (&vm_vma_slab, vma);
 }
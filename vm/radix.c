@@ -0,0 +1,159 @@
+/* radix.c: Radix tree keyed by virtual page number.
+ *
+ * Each node is a page holding RADIX_FANOUT pointers, to the nodes of the next
+ * level or, in the last level, to the values. As in the page tables, nodes
+ * are only freed when the whole tree is destroyed. */
+
+#include "vm/radix.h"
+#include <debug.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define RADIX_FANOUT (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_FANOUT - 1)
+
+/* Number of key bits below the index of a node of LEVEL. */
+static inline unsigned
+level_shift (int level) {
+	return (RADIX_LEVELS - 1 - level) * RADIX_BITS;
+}
+
+/* Returns the address of the slot for KEY in the last level of TREE, creating
+ * the nodes on the way if CREATE is true. Returns a null pointer if a node is
+ * missing, or cannot be created. */
+static void **
+walk (struct radix *tree, uint64_t key, bool create) {
+	void **slot = &tree->root;
+
+	ASSERT (key < RADIX_KEYS);
+
+	for (int level = 0; level < RADIX_LEVELS; level++) {
+		if (*slot == NULL) {
+			if (!create || !(*slot = palloc_get_page (PAL_ZERO)))
+				return NULL;
+		}
+		slot = (void **) *slot + ((key >> level_shift (level)) & RADIX_MASK);
+	}
+	return slot;
+}
+
+/* Returns the value of the smallest key not below FROM in the subtree NODE of
+ * LEVEL, whose keys start at BASE, and stores its key in *KEY. Returns a null
+ * pointer if there is none. */
+static void *
+next_from (void **node, int level, uint64_t base, uint64_t from,
+		uint64_t *key) {
+	unsigned shift = level_shift (level);
+	size_t i = (from > base)? (from - base) >> shift: 0;
+	void *value;
+
+	for (; i < RADIX_FANOUT; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (level == RADIX_LEVELS - 1) {
+			*key = base + i;
+			return node[i];
+		}
+		value = next_from (node[i], level + 1, base + ((uint64_t) i << shift),
+				from, key);
+		if (value)
+			return value;
+	}
+	return NULL;
+}
+
+/* Removes the entries of the subtree NODE of LEVEL in key order, passing each
+ * value to ACTION, and frees its nodes. */
+static void
+destroy_node (struct radix *tree, void **node, int level,
+		radix_action_func *action, void *aux) {
+	void *value;
+
+	for (size_t i = 0; i < RADIX_FANOUT; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (level == RADIX_LEVELS - 1) {
+			/* Remove the entry before ACTION, which may look it up. */
+			value = node[i];
+			node[i] = NULL;
+			tree->cnt--;
+			if (action)
+				action (value, aux);
+		} else {
+			destroy_node (tree, node[i], level + 1, action, aux);
+			node[i] = NULL;
+		}
+	}
+	palloc_free_page (node);
+}
+
+/* Initializes TREE as empty. */
+void
+radix_init (struct radix *tree) {
+	tree->root = NULL;
+	tree->cnt = 0;
+}
+
+/* Removes all the entries of TREE, in key order, passing each value to ACTION
+ * if it is non-null, and frees its memory. TREE is left empty. */
+void
+radix_destroy (struct radix *tree, radix_action_func *action, void *aux) {
+	if (tree->root)
+		destroy_node (tree, tree->root, 0, action, aux);
+	ASSERT (tree->cnt == 0);
+	tree->root = NULL;
+}
+
+/* Maps KEY to VALUE, which must be non-null, in TREE. Fails if KEY is already
+ * mapped, or memory is exhausted. */
+bool
+radix_insert (struct radix *tree, uint64_t key, void *value) {
+	void **slot = walk (tree, key, true);
+
+	ASSERT (value);
+
+	if (!slot || *slot)
+		return false;
+	*slot = value;
+	tree->cnt++;
+	return true;
+}
+
+/* Removes KEY from TREE and returns its value, or a null pointer if it was
+ * not mapped. */
+void *
+radix_remove (struct radix *tree, uint64_t key) {
+	void **slot = walk (tree, key, false);
+	void *value = NULL;
+
+	if (slot && *slot) {
+		value = *slot;
+		*slot = NULL;
+		tree->cnt--;
+	}
+	return value;
+}
+
+/* Returns the value of KEY in TREE, or a null pointer if it is not mapped. */
+void *
+radix_lookup (const struct radix *tree, uint64_t key) {
+	void **slot = walk ((struct radix *) tree, key, false);
+
+	return slot? *slot: NULL;
+}
+
+/* Returns the value of the smallest key of TREE not below *KEY, and stores
+ * that key in *KEY, or returns a null pointer if there is none. Visits TREE in
+ * order when called from *KEY = 0 and then from each key returned plus one. */
+void *
+radix_next (const struct radix *tree, uint64_t *key) {
+	if (tree->root == NULL || *key >= RADIX_KEYS)
+		return NULL;
+	return next_from (tree->root, 0, 0, *key, key);
+}
+
+/* Returns the number of entries in TREE. */
+size_t
+radix_size (const struct radix *tree) {
+	return tree->cnt;
+}
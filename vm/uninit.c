@@ -10,7 +10,6 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
-#include "threads/malloc.h"
 
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
@@ -79,19 +78,19 @@ uninit_destroy (struct page *page) {
 			switch (VM_SUBTYPE (uninit->type)) {
 				case VM_ANON_EXEC:
 					/* Uninitlialized segment. */
-					free (uninit->aux);
+					slab_free (&vm_seg_aux_slab, uninit->aux);
 					break;
 				case VM_ANON_STACK:
+				case 0:
 					break;
 				default:
 					ASSERT (0);
 			}
 			break;
 		case VM_FILE:
-			/* Uninitlialized file page. */
+			/* Uninitlialized file page, whose file is borrowed from its area. */
 			m_elem = (struct file_page *)uninit->aux;
-			file_close (m_elem->file);
-			free (m_elem);
+			slab_free (&vm_file_aux_slab, m_elem);
 			break;
 		default:
 			ASSERT (0);
@@ -1,18 +1,203 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include "threads/fpu.h"
 #include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
-#include <hash.h>
+#include "threads/synch.h"
+#include "devices/timer.h"
+#include "userprog/process.h"
+#include <round.h>
+#include <syscall-nr.h>
 #include <string.h>
 #include <stdio.h>//////////////////////////////////////////////////////////////TEMPORAL: TESTING
 
-static hash_hash_func spt_hash_func;
-static hash_less_func spt_less_func;
-static hash_action_func spt_page_destructor;
-static vm_initializer page_copy;
+static radix_action_func spt_page_destructor;
+
+/* Number of frames of a large page. */
+#define LARGE_PAGES (LPGSIZE / PGSIZE)
+
+/* Maximum number of free frames kept zeroed ahead of time. */
+#define ZERO_POOL_PAGES 32
+
+/* System-wide frame table. Holds one entry per page of the user pool, so that
+ * the frame of any user kernel virtual address is found in O(1) and a victim
+ * may be taken from any process. */
+static struct frame_table {
+	struct frame *frames;		/* Frame entries, indexed by user pool page number. */
+	size_t size;						/* Number of entries in FRAMES. */
+	uint8_t *base;					/* Kernel virtual address of the first user page. */
+	size_t hand;						/* Clock hand: Next frame to be checked on
+													 * eviction. */
+	struct lock lock;				/* Serializes frame allocation, eviction and
+													 * release. */
+	size_t free_cnt;				/* Number of frames left in the user pool. */
+	struct condition io_done;	/* Signaled when the I/O of a frame is done. */
+	size_t io_cnt;					/* Number of frames with I/O in progress. */
+	struct semaphore writeback;	/* Up'd to wake up the writeback daemon. */
+	bool writeback_pending;	/* True if the daemon has been woken up but has
+													 * not run yet. */
+	void *zero_kva;					/* Kernel page of zeros, mapped read-only by the
+													 * demand-zero pages that have only been read. */
+	/* Free frames kept out of the user pool, to be zeroed by the idle thread.
+	 * The first ZEROED_CNT are already zeroed. */
+	struct frame *pool[ZERO_POOL_PAGES];
+	size_t pool_cnt;				/* Number of frames in POOL. */
+	size_t zeroed_cnt;			/* Number of zeroed frames in POOL. */
+	size_t large_cnt;				/* Number of large pages in use. */
+	/* Same-page merging. KSM_TABLE maps checksums, modulo its size, to the last
+	 * frame found with a stable checksum. */
+	struct frame **ksm_table;
+	size_t ksm_mask;				/* Size of KSM_TABLE, minus 1. */
+	size_t ksm_hand;				/* Next frame to be scanned. */
+	struct hash text;				/* Text frames, by contents. */
+	size_t locked_cnt;			/* Number of pages locked by mlock(). */
+	/* Working set sampling. */
+	unsigned ws_round;			/* Current round over the frame table. */
+	size_t ws_total;				/* Pages found accessed on the last round. */
+	size_t ws_next;					/* Pages found accessed so far on this round. */
+} frame_t;
+
+/* Maximum number of large pages in use at once, set by the -lp kernel option.
+ * Large pages are never evicted, so by default they take at most a quarter of
+ * the user pool. */
+size_t vm_large_max = SIZE_MAX;
+
+/* Number of times a frame to be zero filled was requested and found in the
+ * pool of zeroed frames, or not. */
+long long vm_zero_hits;
+long long vm_zero_misses;
+
+/* Same-page merging, enabled by the -ksm kernel option: Every vm_ksm_sleep
+ * milliseconds, vm_ksm_pages frames are scanned for anonymous pages with the
+ * same contents as another frame's. 0 pages disables it. */
+size_t vm_ksm_pages = 0;
+size_t vm_ksm_sleep = 100;
+
+/* Number of frames freed by merging their pages into another frame. */
+long long vm_ksm_merged;
+
+/* Number of pages of executables loaded by sharing the frame of another
+ * process running the same executable. */
+long long vm_text_shared;
+
+/* Maximum number of frames held by a process, set by the -rss kernel option.
+ * A process at the limit replaces its own pages. 0 means no limit. */
+size_t vm_rss_limit = 0;
+
+/* Period in milliseconds of the working set sampler, set by the -ws kernel
+ * option. 0 disables it, and the memory is not shared out among processes. */
+size_t vm_ws_sleep = 0;
+
+/* Caches of the objects created and destroyed with the pages: The pages
+ * themselves, the areas, and the data passed to the initializers of the pages
+ * of file mappings and executable segments. */
+static struct slab_cache page_slab;
+struct slab_cache vm_vma_slab;
+struct slab_cache vm_file_aux_slab;
+struct slab_cache vm_seg_aux_slab;
+
+/* Watermarks of free frames kept by the writeback daemon, set by the -wb
+ * kernel option. The daemon is woken up once fewer than vm_writeback_low
+ * frames are free, and evicts pages until vm_writeback_high frames are free.
+ * A high watermark of 0 disables the daemon. */
+size_t vm_writeback_low = 8;
+size_t vm_writeback_high = 16;
+
+/* Maximum number of pages of a file mapping or of an executable segment
+ * loaded by a single fault, set by the -fa kernel option. */
+size_t vm_fault_around = 16;
+
+static void frame_table_init (void);
+static struct frame *kva_to_frame (void *kva);
+static void frame_link (struct frame *frame, struct page *page);
+static void frame_unlink (struct frame *frame, struct page *page);
+static void vm_free_frame (struct frame *frame);
+static bool spt_copy_page (struct page *parent_pg, struct vma_tree *vmas);
+static bool spt_share_anon_page (struct page *parent_pg);
+static struct frame *vm_evict_frame (struct thread *owner);
+static void vm_writeback_init (void);
+static void vm_ksm_init (void);
+static thread_func vm_ksm_daemon;
+static void vm_ws_init (void);
+static thread_func vm_ws_daemon;
+static void vm_ws_sample (struct frame *frame);
+static size_t vm_ws_size (struct thread *t);
+static size_t vm_ws_share (struct thread *t);
+static bool vm_rss_over (struct thread *t);
+static bool vm_has_spare_frame (void);
+static void vm_ksm_scan (struct frame *frame);
+static bool vm_ksm_merge (struct frame *frame, struct frame *dup);
+static hash_hash_func vm_text_hash;
+static hash_less_func vm_text_less;
+static bool vm_text_key (struct page *page, struct inode **inode, off_t *ofs,
+		size_t *bytes);
+static void vm_text_add (struct frame *frame, struct inode *inode, off_t ofs,
+		size_t bytes);
+static void vm_text_del (struct frame *frame);
+static bool vm_text_claim (struct page *page);
+
+/* Minimum share of the user pool of a process (see vm_ws_share()). */
+#define RSS_MIN_PAGES 16
+
+/* Maximum number of pages swapped in by a single fault. */
+#define RA_MAX_PAGES 16
+
+/* Maximum number of pages written back by a single write of a file mapping's
+ * modified contents (see vm_writeback_area()). */
+#define WB_RUN_PAGES 16
+
+/* Maximum number of frames evicted or written back by the writeback daemon
+ * before it lets the faulting threads take the frame table lock. */
+#define WB_BATCH_PAGES 8
+static thread_func vm_writeback_daemon;
+static void vm_writeback_ahead (void);
+static bool vm_claim_fault_page (struct supplemental_page_table *spt,
+		struct page *page, bool write);
+static bool vm_is_demand_zero (struct page *page);
+static bool vm_is_zero_filled (struct page *page);
+static void vm_unmap_zero (struct page *page);
+static bool vm_file_range (struct page *page, struct file **file, off_t *ofs,
+		size_t *length);
+static bool vm_new_page (enum vm_type type, void *va, bool writable,
+		vm_initializer *init, void *aux);
+static struct page *vm_area_page (struct supplemental_page_table *spt,
+		struct vma *vma, void *va);
+static bool vm_range_is_free (struct supplemental_page_table *spt,
+		void *start, void *end);
+static void spt_vma_destructor (struct vma *vma);
+static bool spt_range_has_pages (struct supplemental_page_table *spt,
+		void *start, void *end);
+static struct page *vm_area_large_page (struct supplemental_page_table *spt,
+		struct vma *vma, void *va);
+static struct page *vm_new_large_page (void *va, bool writable,
+		struct frame *frame);
+static struct frame *vm_get_large_frame (void);
+static void vm_free_large_frame (struct frame *frame);
+static void vm_large_destroy (struct page *page);
+static bool spt_copy_large_page (struct page *parent_pg);
+static bool spt_copy_seg_page (struct page *parent_pg);
+static bool spt_copy_to_anon_page (void *va, const void *kva);
+
+/* Large pages hold a block of LARGE_PAGES frames, pinned for their whole
+ * life, and are only created from areas (see vm_area_large_page()). */
+static const struct page_operations large_ops = {
+	.swap_in = NULL,
+	.swap_out = NULL,
+	.destroy = vm_large_destroy,
+	.type = VM_LARGE,
+};
+static bool vm_claim_file_around (struct supplemental_page_table *spt,
+		struct page *page, size_t max_cnt);
+static bool vm_evict (struct frame *victim);
+static bool vm_frame_locked (struct frame *frame);
+static void vm_io_begin (struct frame *frame);
+static void vm_io_end (struct frame *frame);
+static void vm_wait_io (struct page *page);
+static void vm_writeback_page (struct page *page);
+static void vm_writeback_run (struct page *run[], size_t cnt, uint8_t *buf);
 
 /* Checks if a given address corresponds to the one of a page. */
 bool
@@ -31,7 +216,673 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	slab_cache_init (&page_slab, "page", sizeof (struct page),
+			_Alignof (struct page), NULL);
+	slab_cache_init (&vm_vma_slab, "vma", sizeof (struct vma),
+			_Alignof (struct vma), NULL);
+	slab_cache_init (&vm_file_aux_slab, "file_page", sizeof (struct file_page),
+			_Alignof (struct file_page), NULL);
+	slab_cache_init (&vm_seg_aux_slab, "load_segment_aux",
+			sizeof (struct load_segment_aux), _Alignof (struct load_segment_aux),
+			NULL);
+	frame_table_init ();
+	vm_writeback_init ();
+	vm_ksm_init ();
+	vm_ws_init ();
+}
+
+/* Initializes the frame table, which covers the whole user pool. */
+static void
+frame_table_init (void) {
+	lock_init (&frame_t.lock);
+	cond_init (&frame_t.io_done);
+	frame_t.io_cnt = 0;
+	frame_t.base = palloc_user_pool (&frame_t.size);
+	if (frame_t.size == 0)
+		PANIC ("The user pool is empty");
+	frame_t.frames = (struct frame*)calloc (frame_t.size, sizeof (struct frame));
+	if (!frame_t.frames)
+		PANIC ("Unable to create frame table");
+	for (size_t i = 0; i < frame_t.size; i++) {
+		frame_t.frames[i].kva = frame_t.base + i * PGSIZE;
+		list_init (&frame_t.frames[i].pages);
+	}
+	frame_t.hand = 0;
+	frame_t.free_cnt = frame_t.size;
+	if (vm_large_max == SIZE_MAX)
+		vm_large_max = frame_t.size / LARGE_PAGES / 4;
+	/* The zero frame is taken from the kernel pool, so it is never evicted
+	 * nor handed out. */
+	frame_t.zero_kva = palloc_get_page (PAL_ZERO);
+	if (!frame_t.zero_kva)
+		PANIC ("Unable to allocate the zero frame");
+	if (!hash_init (&frame_t.text, vm_text_hash, vm_text_less, NULL))
+		PANIC ("Unable to create the text table");
+}
+
+/* Starts the writeback daemon, unless disabled. The watermarks are reduced to
+ * fit into the user pool. */
+static void
+vm_writeback_init (void) {
+	sema_init (&frame_t.writeback, 0);
+	frame_t.writeback_pending = false;
+	if (vm_writeback_high == 0)
+		return;
+	if (vm_writeback_high > frame_t.size / 4)
+		vm_writeback_high = frame_t.size / 4;
+	if (vm_writeback_low > vm_writeback_high)
+		vm_writeback_low = vm_writeback_high;
+	if (vm_writeback_high == 0
+			|| thread_create ("vm_writeback", PRI_DEFAULT, vm_writeback_daemon,
+					NULL) == TID_ERROR)
+		vm_writeback_high = vm_writeback_low = 0;
+}
+
+/* Writeback daemon. Whenever the number of free frames drops below the low
+ * watermark, evicts pages until it reaches the high watermark, so that the
+ * page fault path usually finds a free frame. Then writes back the dirty
+ * pages that the clock hand will visit next, so that they can be evicted
+ * without any I/O. The frame table lock is released during each write, and
+ * the daemon yields after every WB_BATCH_PAGES frames. */
+static void
+vm_writeback_daemon (void *aux UNUSED) {
+	struct frame *frame;
+	size_t cnt;
+
+	for (;;) {
+		sema_down (&frame_t.writeback);
+		lock_acquire (&frame_t.lock);
+		frame_t.writeback_pending = false;
+		do {
+			for (cnt = 0; cnt < WB_BATCH_PAGES
+					&& frame_t.free_cnt < vm_writeback_high
+					&& (frame = vm_evict_frame (NULL)); cnt++)
+				vm_free_frame (frame);
+			lock_release (&frame_t.lock);
+			thread_yield ();
+			lock_acquire (&frame_t.lock);
+		} while (cnt == WB_BATCH_PAGES);
+		vm_writeback_ahead ();
+		lock_release (&frame_t.lock);
+	}
+}
+
+/* Starts the same-page merging daemon, if enabled. */
+static void
+vm_ksm_init (void) {
+	size_t size = 1;
+
+	if (vm_ksm_pages == 0)
+		return;
+	while (size < frame_t.size)
+		size *= 2;
+	frame_t.ksm_table = (struct frame**)calloc (size, sizeof (struct frame*));
+	frame_t.ksm_mask = size - 1;
+	frame_t.ksm_hand = 0;
+	if (!frame_t.ksm_table
+			|| thread_create ("vm_ksm", PRI_DEFAULT, vm_ksm_daemon, NULL)
+					== TID_ERROR)
+		vm_ksm_pages = 0;
+}
+
+/* Same-page merging daemon. Scans the frame table in rounds, looking for
+ * frames of anonymous pages (i.e. of forked processes) with the same
+ * contents, which are merged into a single read-only frame until written. */
+static void
+vm_ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (vm_ksm_sleep);
+		for (size_t i = 0; i < vm_ksm_pages && i < frame_t.size; i++) {
+			/* Do not hold the lock for the whole round, so that page faults are
+			 * not delayed. */
+			lock_acquire (&frame_t.lock);
+			vm_ksm_scan (&frame_t.frames[frame_t.ksm_hand]);
+			frame_t.ksm_hand = (frame_t.ksm_hand + 1) % frame_t.size;
+			lock_release (&frame_t.lock);
+		}
+	}
+}
+
+/* Starts the working set sampler, if enabled. */
+static void
+vm_ws_init (void) {
+	if (vm_ws_sleep == 0)
+		return;
+	if (thread_create ("vm_ws", PRI_DEFAULT, vm_ws_daemon, NULL) == TID_ERROR)
+		vm_ws_sleep = 0;
+}
+
+/* Working set sampler. Every vm_ws_sleep milliseconds, makes a round over the
+ * frame table counting, for each process, its pages accessed since the last
+ * round: this is its working set. Under memory contention, the user pool is
+ * shared out among the processes in proportion to their working sets (see
+ * vm_ws_share()). */
+static void
+vm_ws_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (vm_ws_sleep);
+		for (size_t i = 0; i < frame_t.size; i++) {
+			/* Do not hold the lock for the whole round, so that page faults are
+			 * not delayed. */
+			lock_acquire (&frame_t.lock);
+			vm_ws_sample (&frame_t.frames[i]);
+			lock_release (&frame_t.lock);
+		}
+		lock_acquire (&frame_t.lock);
+		frame_t.ws_total = frame_t.ws_next;
+		frame_t.ws_next = 0;
+		frame_t.ws_round++;
+		lock_release (&frame_t.lock);
+	}
+}
+
+/* Counts the pages of FRAME accessed since last sampled or checked by the
+ * clock. Their accessed bits are cleared, so the frame is marked as
+ * referenced for the clock to still give it a second chance.
+ * The frame table lock must be held. */
+static void
+vm_ws_sample (struct frame *frame) {
+	struct page *page;
+	struct thread *t;
+	struct list_elem *e;
+
+	if (!frame->page || frame->pinned)
+		return;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		page = list_entry (e, struct page, f_elem);
+		t = page->t;
+		if (!pml4_is_accessed (t->pml4, page->va))
+			continue;
+		pml4_set_accessed (t->pml4, page->va, false);
+		frame->referenced = true;
+		if (t->ws_round != frame_t.ws_round) {
+			t->ws_size = (t->ws_round + 1 == frame_t.ws_round)? t->ws_next: 0;
+			t->ws_next = 0;
+			t->ws_round = frame_t.ws_round;
+		}
+		t->ws_next++;
+		frame_t.ws_next++;
+	}
+}
+
+/* Returns the size of the working set of T, as found on the last round of the
+ * sampler.
+ * The frame table lock must be held. */
+static size_t
+vm_ws_size (struct thread *t) {
+	if (t->ws_round == frame_t.ws_round)
+		return t->ws_size;
+	if (t->ws_round + 1 == frame_t.ws_round)
+		return t->ws_next;
+	return 0;
+}
+
+/* Returns the number of frames T may hold under memory contention: Its share
+ * of the user pool, in proportion to its working set, but at least
+ * RSS_MIN_PAGES so that a process that has just started is not starved.
+ * There is no limit if the sampler is disabled.
+ * The frame table lock must be held. */
+static size_t
+vm_ws_share (struct thread *t) {
+	size_t share;
+
+	if (vm_ws_sleep == 0 || frame_t.ws_total == 0)
+		return SIZE_MAX;
+	share = frame_t.size * vm_ws_size (t) / frame_t.ws_total;
+	return (share > RSS_MIN_PAGES)? share: RSS_MIN_PAGES;
+}
+
+/* Returns true if T must replace its own pages to take a new frame: It is at
+ * the resident set limit, or memory is short and it is over its share.
+ * The frame table lock must be held. */
+static bool
+vm_rss_over (struct thread *t) {
+	if (vm_rss_limit > 0 && t->rss >= vm_rss_limit)
+		return true;
+	return frame_t.free_cnt < vm_writeback_low && t->rss >= vm_ws_share (t);
+}
+
+/* Returns true if a frame can be taken for a page of the current thread that
+ * it has not faulted yet (read-ahead, fault-around) without evicting: There
+ * are more free frames than the low watermark, and the thread need not
+ * replace its own pages. Other threads may still take the frames meanwhile,
+ * so this is only a hint. */
+static bool
+vm_has_spare_frame (void) {
+	bool spare;
+
+	lock_acquire (&frame_t.lock);
+	spare = frame_t.free_cnt > vm_writeback_low
+			&& !vm_rss_over (thread_current ());
+	lock_release (&frame_t.lock);
+	return spare;
+}
+
+/* Returns true if FRAME holds only anonymous pages and may be merged.
+ * The frame table lock must be held. */
+static bool
+vm_ksm_mergeable (struct frame *frame) {
+	struct list_elem *e;
+
+	if (!frame->page || frame->pinned)
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (list_entry (e, struct page, f_elem)->operations->type != VM_ANON)
+			return false;
+	return true;
+}
+
+/* Returns the checksum of the contents of FRAME. */
+static uint32_t
+vm_ksm_checksum (struct frame *frame) {
+	const uint64_t *w = frame->kva;
+	uint64_t sum = 0;
+
+	for (size_t i = 0; i < PGSIZE / sizeof *w; i++)
+		sum = (sum ^ w[i]) * 0x100000001b3ULL;
+	return (uint32_t) (sum ^ (sum >> 32));
+}
+
+/* Scans FRAME: If its checksum is the same as on the previous round, so that
+ * it is unlikely to be written soon, it is merged with the last frame found
+ * with that checksum, if their contents are the same.
+ * The frame table lock must be held. */
+static void
+vm_ksm_scan (struct frame *frame) {
+	struct frame **slot, *dup;
+	uint32_t sum;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	if (!vm_ksm_mergeable (frame))
+		return;
+	sum = vm_ksm_checksum (frame);
+	if (sum != frame->ksm_sum) {
+		frame->ksm_sum = sum;
+		return;
+	}
+	/* The frame in the table may have been freed or changed since. */
+	slot = &frame_t.ksm_table[sum & frame_t.ksm_mask];
+	dup = *slot;
+	if (dup && dup != frame && dup->ksm_sum == sum && vm_ksm_mergeable (dup)
+			&& vm_ksm_merge (frame, dup))
+		return;
+	*slot = frame;
+}
+
+/* Write-protects the pages of FRAME, so that its contents do not change. */
+static void
+vm_ksm_protect (struct frame *frame) {
+	struct list_elem *e;
+	struct page *page;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		page = list_entry (e, struct page, f_elem);
+		pml4_set_writable (page->t->pml4, page->va, false);
+	}
+}
+
+/* Moves the pages of FRAME to DUP, if both frames hold the same contents, and
+ * frees FRAME. The pages of both frames are then mapped read-only, and get
+ * copies again on write (see vm_handle_wp()). Returns false if the contents
+ * differ.
+ * The frame table lock must be held. */
+static bool
+vm_ksm_merge (struct frame *frame, struct frame *dup) {
+	struct list_elem *e;
+	struct page *page;
+	uint64_t *pml4;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (frame != dup);
+
+	if (!fpu_page_equal (frame->kva, dup->kva))
+		return false;
+	/* Compare again once the pages cannot be written, as the lock does not
+	 * keep their owners from running. */
+	vm_ksm_protect (frame);
+	vm_ksm_protect (dup);
+	if (!fpu_page_equal (frame->kva, dup->kva))
+		return false;
+
+	for (e = list_begin (&dup->pages); e != list_end (&dup->pages);
+			e = list_next (e))
+		anon_share_frame (list_entry (e, struct page, f_elem));
+	while (!list_empty (&frame->pages)) {
+		page = list_entry (list_front (&frame->pages), struct page, f_elem);
+		pml4 = page->t->pml4;
+		anon_share_frame (page);
+		pml4_clear_page (pml4, page->va);
+		frame_unlink (frame, page);
+		frame_link (dup, page);
+		ASSERT (pml4_set_page (pml4, page->va, dup->kva, false));
+	}
+	vm_free_frame (frame);
+	vm_ksm_merged++;
+	return true;
+}
+
+/* Writes back the dirty pages of the next frames ahead of the clock hand,
+ * up to the high watermark. Shared frames are skipped, as they are mapped
+ * read-only. Each page is written with the frame table lock released (see
+ * vm_writeback_page()), and the lock is also let go after every
+ * WB_BATCH_PAGES pages, so that faults get in between.
+ * The frame table lock must be held. */
+static void
+vm_writeback_ahead (void) {
+	struct frame *frame;
+	struct page *page;
+	size_t cnt = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	for (size_t i = 0; i < vm_writeback_high && i < frame_t.size; i++) {
+		frame = &frame_t.frames[(frame_t.hand + i) % frame_t.size];
+		page = frame->page;
+		if (!page || frame->pinned || frame->ref_cnt != 1
+				|| !pml4_is_dirty (page->t->pml4, page->va))
+			continue;
+		vm_writeback_page (page);
+		if (++cnt % WB_BATCH_PAGES == 0) {
+			lock_release (&frame_t.lock);
+			thread_yield ();
+			lock_acquire (&frame_t.lock);
+		}
+	}
+}
+
+/* Writes back PAGE, which must be in the main memory and hold its frame
+ * alone, if modified, so that it can then be evicted or destroyed without any
+ * I/O. Its dirty bit is cleared first, so that writes made during the I/O are
+ * not lost, and its frame is pinned and its I/O in progress meanwhile, while
+ * the frame table lock is released.
+ * The frame table lock must be held. */
+static void
+vm_writeback_page (struct page *page) {
+	struct frame *frame = page->frame;
+	uint64_t *pml4 = page->t->pml4;
+	bool success = true;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (frame && frame->ref_cnt == 1 && !frame->pinned);
+	ASSERT (pml4_get_page (pml4, page->va) == frame->kva);
+
+	if (!pml4_is_dirty (pml4, page->va))
+		return;
+	pml4_set_dirty (pml4, page->va, false);
+	frame->pinned = true;
+	vm_io_begin (frame);
+	lock_release (&frame_t.lock);
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_ANON:
+			success = anon_writeback (page);
+			break;
+		case VM_FILE:
+			success = file_map_writeback (page);
+			break;
+		default:
+			NOT_REACHED ();
+	}
+	lock_acquire (&frame_t.lock);
+	vm_io_end (frame);
+	frame->pinned = false;
+	/* Without a swap slot, the page is still to be written out. */
+	if (!success)
+		pml4_set_dirty (pml4, page->va, true);
+}
+
+/* Writes back the CNT modified file mapped pages in RUN, as
+ * file_map_writeback_run() does, with the frame table lock released
+ * meanwhile. Each page must hold its frame alone.
+ * The frame table lock must be held. */
+static void
+vm_writeback_run (struct page *run[], size_t cnt, uint8_t *buf) {
+	struct frame *frame;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	for (i = 0; i < cnt; i++) {
+		frame = run[i]->frame;
+		ASSERT (frame && frame->ref_cnt == 1 && !frame->pinned);
+		pml4_set_dirty (run[i]->t->pml4, run[i]->va, false);
+		frame->pinned = true;
+		vm_io_begin (frame);
+	}
+	lock_release (&frame_t.lock);
+	file_map_writeback_run (run, cnt, buf);
+	lock_acquire (&frame_t.lock);
+	for (i = 0; i < cnt; i++) {
+		frame = run[i]->frame;
+		vm_io_end (frame);
+		frame->pinned = false;
+	}
+}
+
+/* Marks the I/O of FRAME, which must be pinned, in progress, so that the frame
+ * table lock may be released while its pages are written out. Being pinned,
+ * FRAME is not chosen as a victim, written back nor merged meanwhile; it is
+ * also removed from the text frames, so that no page is linked to it, and no
+ * page is unlinked from it either (see vm_wait_io()).
+ * The frame table lock must be held. */
+static void
+vm_io_begin (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (frame->pinned && !frame->io);
+
+	vm_text_del (frame);
+	frame->io = true;
+	frame_t.io_cnt++;
+}
+
+/* Ends the I/O of FRAME, which is left pinned, and wakes up those waiting for
+ * it.
+ * The frame table lock must be held. */
+static void
+vm_io_end (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (frame->io && frame_t.io_cnt > 0);
+
+	frame->io = false;
+	frame_t.io_cnt--;
+	cond_broadcast (&frame_t.io_done, &frame_t.lock);
+}
+
+/* Waits until the I/O of PAGE's frame, if any, is done, before PAGE is
+ * linked to or unlinked from a frame, or destroyed. The frame table lock is
+ * released meanwhile, so PAGE may have been evicted on return.
+ * The frame table lock must be held. */
+static void
+vm_wait_io (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	while (page->frame && page->frame->io)
+		cond_wait (&frame_t.io_done, &frame_t.lock);
+}
+
+/* Returns the frame table entry of the user page at KVA. */
+static struct frame *
+kva_to_frame (void *kva) {
+	size_t idx;
+
+	ASSERT (vm_is_page_addr (kva));
+	ASSERT ((uint8_t*)kva >= frame_t.base);
+	idx = ((uint8_t*)kva - frame_t.base) / PGSIZE;
+	ASSERT (idx < frame_t.size);
+	ASSERT (frame_t.frames[idx].kva == kva);
+	return &frame_t.frames[idx];
+}
+
+/* Adds PAGE to the pages held by FRAME. A text frame stops being one unless
+ * PAGE is a read-only page of the same contents. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	struct inode *inode;
+	off_t ofs;
+	size_t bytes;
+
+	ASSERT (frame && page && !page->frame);
+
+	if (frame->t_inode && !(vm_text_key (page, &inode, &ofs, &bytes)
+			&& inode == frame->t_inode && ofs == frame->t_ofs
+			&& bytes == frame->t_bytes))
+		vm_text_del (frame);
+
+	list_push_back (&frame->pages, &page->f_elem);
+	frame->ref_cnt++;
+	if (!frame->page)
+		frame->page = page;
+	page->frame = frame;
+	page->t->rss += (page->operations->type == VM_LARGE)? LARGE_PAGES: 1;
+}
+
+/* Removes PAGE from the pages held by FRAME. */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	ASSERT (frame && page && page->frame == frame);
+	ASSERT (frame->ref_cnt > 0);
+
+	list_remove (&page->f_elem);
+	frame->ref_cnt--;
+	if (frame->page == page)
+		frame->page = (frame->ref_cnt)?
+				list_entry (list_front (&frame->pages), struct page, f_elem): NULL;
+	page->frame = NULL;
+	page->t->rss -= (page->operations->type == VM_LARGE)? LARGE_PAGES: 1;
+	if (frame->ref_cnt == 0)
+		vm_text_del (frame);
+}
+
+/* Returns true if PAGE, which is not in the main memory, is a read-only page
+ * of its owner's executable, and stores its contents in *INODE, *OFS and
+ * *BYTES: BYTES bytes of the executable's INODE at offset OFS, then zeros. */
+static bool
+vm_text_key (struct page *page, struct inode **inode, off_t *ofs,
+		size_t *bytes) {
+	struct load_segment_aux *aux;
+
+	if (page->writable || page->frame || !page->t->executable)
+		return false;
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (page->uninit.type != (VM_ANON | VM_ANON_EXEC))
+				return false;
+			aux = (struct load_segment_aux*)page->uninit.aux;
+			if (aux->file != page->t->executable)
+				return false;
+			*ofs = aux->offset;
+			*bytes = aux->read_bytes;
+			break;
+		case VM_ANON:
+			if (page->anon.a_type != ANON_EXEC || !page->anon.exec_clean
+					|| page->anon.idx != SWAP_NONE)
+				return false;
+			*ofs = page->anon.exec_ofs;
+			*bytes = page->anon.exec_bytes;
+			break;
+		default:
+			return false;
+	}
+	*inode = file_get_inode (page->t->executable);
+	return true;
+}
+
+/* Hash function for a text frame holding a hash_elem E. */
+static uint64_t
+vm_text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	struct frame *frame = hash_entry (e, struct frame, t_elem);
+
+	return hash_bytes (&frame->t_inode, sizeof frame->t_inode)
+			^ hash_int (frame->t_ofs) ^ hash_int (frame->t_bytes);
+}
+
+/* Returns true if text frame A holds contents ordered before B's. */
+static bool
+vm_text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	struct frame *a = hash_entry (a_, struct frame, t_elem);
+	struct frame *b = hash_entry (b_, struct frame, t_elem);
+
+	if (a->t_inode != b->t_inode)
+		return a->t_inode < b->t_inode;
+	if (a->t_ofs != b->t_ofs)
+		return a->t_ofs < b->t_ofs;
+	return a->t_bytes < b->t_bytes;
+}
+
+/* Makes FRAME, which has just been loaded with BYTES bytes of the executable's
+ * INODE at offset OFS, a text frame, unless another frame holds the same.
+ * The frame table lock must be held. */
+static void
+vm_text_add (struct frame *frame, struct inode *inode, off_t ofs,
+		size_t bytes) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (!frame->t_inode);
+
+	frame->t_inode = inode;
+	frame->t_ofs = ofs;
+	frame->t_bytes = bytes;
+	if (hash_insert (&frame_t.text, &frame->t_elem))
+		frame->t_inode = NULL;
+}
+
+/* Removes FRAME from the text frames, if it is one.
+ * The frame table lock must be held, unless FRAME is pinned. */
+static void
+vm_text_del (struct frame *frame) {
+	if (frame->t_inode) {
+		hash_delete (&frame_t.text, &frame->t_elem);
+		frame->t_inode = NULL;
+	}
+}
+
+/* Loads PAGE, which is not in the main memory, by mapping it to the text frame
+ * holding its contents, if any. Returns false if there is none.
+ * A frame found is only trusted while one of its pages belongs to a process
+ * still holding the executable open, as the inode may be freed otherwise.*/
+static bool
+vm_text_claim (struct page *page) {
+	struct frame temp, *frame = NULL;
+	struct hash_elem *e;
+	void *aux;
+
+	if (!vm_text_key (page, &temp.t_inode, &temp.t_ofs, &temp.t_bytes))
+		return false;
+
+	lock_acquire (&frame_t.lock);
+	e = hash_find (&frame_t.text, &temp.t_elem);
+	if (e) {
+		frame = hash_entry (e, struct frame, t_elem);
+		ASSERT (frame->page);
+		if (!frame->page->t->executable
+				|| file_get_inode (frame->page->t->executable) != temp.t_inode) {
+			vm_text_del (frame);
+			frame = NULL;
+		}
+	}
+	if (frame) {
+		vm_unmap_zero (page);
+		frame_link (frame, page);
+		if (!pml4_set_page (page->t->pml4, page->va, frame->kva, false)) {
+			frame_unlink (frame, page);
+			frame = NULL;
+		} else {
+			/* Initialize the page as lazy_load_segment() would, but for the
+			 * reading. */
+			if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+				aux = page->uninit.aux;
+				ASSERT (anon_initializer (page, page->uninit.type, frame->kva));
+				slab_free (&vm_seg_aux_slab, aux);
+			}
+			anon_exec_loaded (page, temp.t_ofs, temp.t_bytes);
+			vm_text_shared++;
+		}
+	}
+	lock_release (&frame_t.lock);
+	return frame != NULL;
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -49,56 +900,314 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
- * `vm_alloc_page`. */
+ * `vm_alloc_page`. Fails if VA is already taken by a page or an area. */
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *va, bool writable,
-		vm_initializer *init UNUSED, void *aux UNUSED) {
+		vm_initializer *init, void *aux) {
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	ASSERT (VM_TYPE (type) != VM_UNINIT);
+	ASSERT (vm_is_page_addr (va)); ////////////////////////////////////////////Debugging purposes: May be incorrect
+
+	/* Check wheter the upage is already occupied or not. */
+	if (spt_lookup_page (spt, va) || vma_find (&spt->vmas, va))
+		return false;
+	return vm_new_page (type, va, writable, init, aux);
+}
+
+/* Creates an uninit page at VA, which must be free, in the current thread's
+ * spt. */
+static bool
+vm_new_page (enum vm_type type, void *va, bool writable,
+		vm_initializer *init, void *aux) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool (*init_pointer)(struct page *, enum vm_type, void *);
 	struct page *new_page;
 
-	ASSERT (VM_TYPE (type) != VM_UNINIT);
-	ASSERT (vm_is_page_addr (va)); ////////////////////////////////////////////Debugging purposes: May be incorrect
+	/* Create the page, fetch the initialier according to the VM type,
+	 * and then create "uninit" page struct by calling uninit_new. */
+	new_page = (struct page*)slab_alloc (&page_slab);
+	if (!new_page)
+		return false;
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			init_pointer = anon_initializer;
+			break;
+		case VM_FILE:
+			init_pointer = file_map_initializer;
+			break;
+		default:
+			ASSERT (0);
+	}
+	uninit_new (new_page, va, init, type, aux, init_pointer);
+	new_page->writable = writable;
+	new_page->t = thread_current ();
+	/* Insert the page into the spt, which may need memory for its nodes. */
+	if (!spt_insert_page (spt, new_page)) {
+		slab_free (&page_slab, new_page);
+		return false;
+	}
+	return true;
+}
+
+/* Creates an area of PAGE_CNT pages starting at START in the current
+ * thread's address space, whose pages are only created when first accessed.
+ * TYPE is either VM_FILE, for a mapping of FILE, which the area takes over,
+ * or VM_ANON | VM_ANON_EXEC, for a segment of the current thread's
+ * executable FILE. The pages hold READ_BYTES bytes of FILE starting at
+ * offset OFS, and are zeroed after them. Fails if the area would overlap a
+ * page or another area, leaving FILE open. */
+bool
+vm_alloc_area (enum vm_type type, void *start, size_t page_cnt, bool writable,
+		vm_initializer *init, struct file *file, off_t ofs, size_t read_bytes) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = start + page_cnt * PGSIZE;
+	struct vma *vma;
+
+	ASSERT (type == VM_FILE || type == (VM_ANON | VM_ANON_EXEC));
+	ASSERT (type == VM_FILE || file == thread_current ()->executable);
+	ASSERT (read_bytes <= page_cnt * PGSIZE);
+
+	if (!vm_is_page_addr (start) || page_cnt == 0
+			|| page_cnt > ((uintptr_t)KERN_BASE - (uintptr_t)start) / PGSIZE
+			|| !vm_range_is_free (spt, start, end))
+		return false;
+	vma = (struct vma*)slab_alloc (&vm_vma_slab);
+	if (!vma)
+		return false;
+	vma->start = start;
+	vma->end = end;
+	vma->type = type;
+	vma->writable = writable;
+	vma->file = (type == VM_FILE)? file: NULL;
+	vma->offset = ofs;
+	vma->read_bytes = read_bytes;
+	vma->init = init;
+	vma->advice = MADV_NORMAL;
+	ASSERT (vma_insert (&spt->vmas, vma));
+	return true;
+}
+
+/* Returns true if no page nor area of SPT lies in [START, END). */
+static bool
+vm_range_is_free (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	return !vma_overlaps (&spt->vmas, start, end)
+			&& !spt_range_has_pages (spt, start, end);
+}
+
+/* Returns true if a page of SPT lies in [START, END). */
+static bool
+spt_range_has_pages (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	uint64_t pg = pg_no (start);
+
+	return radix_next (&spt->pages, &pg) && pg < pg_no (end);
+}
+
+/* Creates the page at VA of VMA, an area of SPT, which must be the current
+ * thread's, and returns it, or NULL if memory is exhausted. */
+static struct page *
+vm_area_page (struct supplemental_page_table *spt, struct vma *vma, void *va) {
+	struct file_page *file_aux;
+	struct load_segment_aux *seg_aux;
+	struct page *page;
+	size_t page_ofs = va - vma->start, length = 0;
+	off_t ofs;
+	void *aux;
+
+	ASSERT (spt == &thread_current ()->spt);
+	ASSERT (vma->start <= va && va < vma->end);
+
+	if ((page = vm_area_large_page (spt, vma, va)))
+		return page;
+	if (page_ofs < vma->read_bytes)
+		length = (vma->read_bytes - page_ofs < PGSIZE)?
+				vma->read_bytes - page_ofs: PGSIZE;
+	/* Pages past the contents keep the offset of their end, which is never
+	 * past the end of the file. */
+	ofs = vma->offset + (off_t)((page_ofs < vma->read_bytes)?
+			page_ofs: vma->read_bytes);
+
+	if (VM_TYPE (vma->type) == VM_FILE) {
+		file_aux = (struct file_page*)slab_alloc (&vm_file_aux_slab);
+		if (!file_aux)
+			return NULL;
+		file_aux->file = vma->file;
+		file_aux->offset = ofs;
+		file_aux->length = length;
+		aux = file_aux;
+	} else {
+		seg_aux = (struct load_segment_aux*)slab_alloc (&vm_seg_aux_slab);
+		if (!seg_aux)
+			return NULL;
+		seg_aux->file = thread_current ()->executable;
+		seg_aux->offset = ofs;
+		seg_aux->read_bytes = length;
+		aux = seg_aux;
+	}
+	if (!vm_new_page (vma->type, va, vma->writable, vma->init, aux)) {
+		slab_free ((VM_TYPE (vma->type) == VM_FILE)?
+				&vm_file_aux_slab: &vm_seg_aux_slab, aux);
+		return NULL;
+	}
+	return spt_lookup_page (spt, va);
+}
+
+/* Creates the large page of VMA, an area of SPT, which must be the current
+ * thread's, holding VA, and returns it, or NULL if it cannot be made a large
+ * page. That is the case if the large page is not fully inside VMA, already
+ * holds pages, or would have to be written back to a file, or if there is no
+ * block of free frames for it. */
+static struct page *
+vm_area_large_page (struct supplemental_page_table *spt, struct vma *vma,
+		void *va) {
+	void *start = lpg_round_down (va);
+	size_t page_ofs = start - vma->start, length = 0;
+	struct file *file;
+	struct frame *frame;
+	struct page *page;
+
+	if (vm_large_max == 0 || start < vma->start || start + LPGSIZE > vma->end
+			|| (VM_TYPE (vma->type) == VM_FILE && vma->writable)
+			|| spt_range_has_pages (spt, start, start + LPGSIZE)
+			|| !(frame = vm_get_large_frame ()))
+		return NULL;
+
+	/* Load the contents. */
+	file = (VM_TYPE (vma->type) == VM_FILE)?
+			vma->file: thread_current ()->executable;
+	if (page_ofs < vma->read_bytes)
+		length = (vma->read_bytes - page_ofs < LPGSIZE)?
+				vma->read_bytes - page_ofs: LPGSIZE;
+	if ((size_t)file_read_at (file, frame->kva, length,
+			vma->offset + (off_t)page_ofs) != length
+			|| !(page = vm_new_large_page (start, vma->writable, frame))) {
+		lock_acquire (&frame_t.lock);
+		vm_free_large_frame (frame);
+		lock_release (&frame_t.lock);
+		return NULL;
+	}
+	memset (frame->kva + length, 0, LPGSIZE - length);
+	return page;
+}
+
+/* Creates in the current thread's spt a large page at VA holding FRAME, the
+ * first of a block taken by vm_get_large_frame(), and returns it, or NULL if
+ * memory is exhausted. The page is mapped when claimed. */
+static struct page *
+vm_new_large_page (void *va, bool writable, struct frame *frame) {
+	struct page *page;
+
+	ASSERT (((uintptr_t)va & LPGMASK) == 0);
+
+	page = (struct page*)slab_alloc (&page_slab);
+	if (!page)
+		return NULL;
+	page->operations = &large_ops;
+	page->va = va;
+	page->frame = NULL;
+	page->writable = writable;
+	page->locked = false;
+	page->t = thread_current ();
+	lock_acquire (&frame_t.lock);
+	frame_link (frame, page);
+	lock_release (&frame_t.lock);
+	if (!spt_insert_page (&page->t->spt, page)) {
+		/* Leave FRAME unlinked, for the caller to free. */
+		lock_acquire (&frame_t.lock);
+		frame_unlink (frame, page);
+		lock_release (&frame_t.lock);
+		slab_free (&page_slab, page);
+		return NULL;
+	}
+	return page;
+}
+
+/* Takes a block of LARGE_PAGES free frames aligned to LPGSIZE, all pinned,
+ * and returns the first one, or NULL if there is none or the large pages
+ * would leave too few frames for the rest. */
+static struct frame *
+vm_get_large_frame (void) {
+	struct frame *frame = NULL;
+	void *kva;
+
+	lock_acquire (&frame_t.lock);
+	if (frame_t.large_cnt < vm_large_max
+			&& frame_t.free_cnt >= LARGE_PAGES + vm_writeback_high
+			&& (kva = palloc_get_aligned (PAL_USER, LARGE_PAGES))) {
+		frame = kva_to_frame (kva);
+		for (size_t i = 0; i < LARGE_PAGES; i++) {
+			ASSERT (!frame[i].page);
+			frame[i].pinned = true;
+		}
+		frame_t.free_cnt -= LARGE_PAGES;
+		frame_t.large_cnt++;
+	}
+	lock_release (&frame_t.lock);
+	return frame;
+}
+
+/* Gives back the block of frames starting at FRAME, taken by
+ * vm_get_large_frame().
+ * The frame table lock must be held. */
+static void
+vm_free_large_frame (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (!frame->page && frame->ref_cnt == 0);
 
-	/* Check wheter the upage is already occupied or not. */
-	if (!spt_find_page (spt, va)) {
-		bool (*init_pointer)(struct page *, enum vm_type, void *);
-		/* Create the page, fetch the initialier according to the VM type,
-		 * and then create "uninit" page struct by calling uninit_new. */
-		new_page = (struct page*)malloc (sizeof (struct page));
-		if (!new_page)
-			return false;
-		switch (VM_TYPE (type)) {
-			case VM_ANON:
-				init_pointer = anon_initializer;
-				break;
-			case VM_FILE:
-				init_pointer = file_map_initializer;
-				break;
-			default:
-				ASSERT (0);
-		}
-		uninit_new (new_page, va, init, type, aux, init_pointer);
-		new_page->writable = writable;
-		new_page->t = thread_current ();
-		/* Insert the page into the spt. */
-		ASSERT (spt_insert_page (spt, new_page));
-		//printf("vm_alloc_page_with_initializer: new_page addr: %p\n", new_page); ///TEMPORAL: TESTING
-		return true;
+	for (size_t i = 0; i < LARGE_PAGES; i++) {
+		frame[i].pinned = false;
+		frame[i].zeroed = false;
 	}
-	return false;
+	palloc_free_multiple (frame->kva, LARGE_PAGES);
+	frame_t.free_cnt += LARGE_PAGES;
+	frame_t.large_cnt--;
+}
+
+/* Destroys PAGE, a large page, which must NOT be in its owner's spt.
+ * The frame table lock must be held. */
+static void
+vm_large_destroy (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (page->operations->type == VM_LARGE && frame);
+
+	if (page->t->pml4)
+		pml4_clear_large_page (page->t->pml4, page->va);
+	frame_unlink (frame, page);
+	vm_free_large_frame (frame);
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Find VA from spt and return page. On error, return NULL.
+ * If VA lies in an area of the current thread's spt whose page has not been
+ * created yet, the page is created. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt, void *va) {
-	struct page temp;
-	struct hash_elem *elem;
+	struct page *page;
+	struct vma *vma;
+
+	ASSERT (spt);
+
+	va = pg_round_down (va);
+	page = spt_lookup_page (spt, va);
+	if (!page && va && spt == &thread_current ()->spt
+			&& (vma = vma_find (&spt->vmas, va)))
+		page = vm_area_page (spt, vma, va);
+	return page;
+}
+
+/* Returns the page of SPT at VA if it has been created, or NULL. Unlike
+ * spt_find_page(), never creates the pages of areas. */
+struct page *
+spt_lookup_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page;
 
 	ASSERT (spt);
 
@@ -106,9 +1215,14 @@ spt_find_page (struct supplemental_page_table *spt, void *va) {
 	if (!va)
 		return NULL;
 
-	temp.va = va;
-	elem = hash_find (&spt->table, &temp.h_elem);
-	return (elem)? hash_entry(elem, struct page, h_elem): NULL;
+	page = radix_lookup (&spt->pages, pg_no (va));
+	if (!page && frame_t.large_cnt > 0) {
+		/* VA may lie in a large page, which has a single entry. */
+		page = radix_lookup (&spt->pages, pg_no (lpg_round_down (va)));
+		if (page && page->operations->type != VM_LARGE)
+			page = NULL;
+	}
+	return page;
 }
 
 /* Insert PAGE into spt with validation. */
@@ -117,128 +1231,329 @@ spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
 	ASSERT (spt);
 	ASSERT (page);
 	ASSERT (vm_is_page_addr (page->va)); ////////////////////////////////////////////Debugging purposes: May be incorrect
-	return hash_insert (&spt->table, &page->h_elem) == NULL;
+	return radix_insert (&spt->pages, pg_no (page->va), page);
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	ASSERT (spt);
 	ASSERT (page);
-	spt_page_destructor (&page->h_elem, spt);
-}
-
-/* Returns an integer in the range [0, 2] which specifies how 'good' a page is
- * to be evicted, being that each value means:
- * 		0: The page has been accessed and written.
- *		1: The page has been accessed but not written.
- *		2: The page has not been accessed nor written.
- * The page must be mapped to a kernel virtual addr through a frame. */
-static int
-rank_page (struct page *page, uint64_t *pml4) {
-	ASSERT (pml4);
-	ASSERT (page && page->frame && page->frame->page == page
-			&& pml4_get_page (pml4, page->va) == page->frame->kva);
-
-	if (pml4_is_dirty (pml4, page->va))
-		return 0;
-	else if (pml4_is_accessed (pml4, page->va))
-		return 1;
-	return 2;
+	spt_page_destructor (page, spt);
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.
+ * Implements the clock (second chance) algorithm over the frame table: The
+ * hand skips free and pinned frames, and gives a second chance to those whose
+ * pages have been accessed since the last sweep by clearing their accessed
+ * bits. If OWNER is not null, only the frames held by OWNER alone are taken.
+ * Otherwise, the first sweep also skips the frames of processes within their
+ * share of the user pool (see vm_ws_share()). Three sweeps are enough to find
+ * a victim, if there is any.
+ * The frame table lock must be held. */
 static struct frame *
-vm_get_victim (void) {
-	struct supplemental_page_table *spt = &thread_current ()->spt;
-	uint64_t *pml4 = thread_current ()->pml4;
-	struct hash_iterator it;
-	struct hash_elem *e;
+vm_get_victim (struct thread *owner) {
+	struct frame *frame;
 	struct page *page;
-	struct frame *victim = NULL;
-	int curr_rank, victim_rank = -1;
-
-	hash_first (&it, &spt->table);
-	while ((e = hash_next (&it))) {
-		page = hash_entry (e, struct page, h_elem);
-		ASSERT (vm_is_page_addr (page->va));
-		if (page->frame && pml4_get_page (pml4, page->va)) {
-			/* Mapped page found. */
-			curr_rank = rank_page (page, pml4);
-			if (!victim || curr_rank > victim_rank) {
-				/* Chose as victim if it's the first mapped page found or if the current
-				page has a better 'rank' than the current victim. Return if the highest
-				rank was found. */
-				victim = page->frame;
-				if ((victim_rank = curr_rank) == 2)
-					break;
+	struct list_elem *e;
+	uint64_t *pml4;
+	bool accessed;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	for (size_t i = 0; i < 3 * frame_t.size; i++) {
+		frame = &frame_t.frames[frame_t.hand];
+		frame_t.hand = (frame_t.hand + 1) % frame_t.size;
+		if (!frame->page || frame->pinned || vm_frame_locked (frame))
+			continue;
+		if (owner && (frame->ref_cnt != 1 || frame->page->t != owner))
+			continue;
+		if (!owner && vm_ws_sleep > 0 && i < frame_t.size && frame->ref_cnt == 1
+				&& frame->page->t->rss <= vm_ws_share (frame->page->t))
+			continue;
+		/* A shared frame has been accessed if any of its pages has, or if the
+		 * working set sampler found it so. */
+		accessed = frame->referenced;
+		frame->referenced = false;
+		for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+				e = list_next (e)) {
+			page = list_entry (e, struct page, f_elem);
+			ASSERT (page->frame == frame && thread_is_user (page->t));
+			pml4 = page->t->pml4;
+			ASSERT (pml4_get_page (pml4, page->va) == frame->kva);
+			if (pml4_is_accessed (pml4, page->va)) {
+				pml4_set_accessed (pml4, page->va, false);
+				accessed = true;
 			}
 		}
+		if (!accessed)
+			return frame;
 	}
-	return victim;
+	return NULL;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Evict the pages held by one frame, held by OWNER alone if not null, and
+ * return such frame. Return NULL on error.
+ * The frame table lock must be held, and is released while the pages are
+ * written out (see vm_evict()). */
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim = vm_get_victim ();
-	uint64_t *pml4 = thread_current ()->pml4;
-	struct page *page;
+vm_evict_frame (struct thread *owner) {
+	struct frame *victim = vm_get_victim (owner);
 
 	/* Swap out the victim and return the evicted frame. */
-	if (victim) {
-		page = victim->page;
-		ASSERT (page && page->frame == victim
-				&& victim->kva == pml4_get_page (pml4, page->va));
-		if (swap_out (page)) {
-			/* Remove all links between page and frame. */
-			pml4_clear_page (pml4, page->va);
-			page->frame = NULL;
-			victim->page = NULL;
-			return victim;
+	if (victim && vm_evict (victim))
+		return victim;
+	return NULL;
+}
+
+/* Swaps out the pages held by VICTIM, which is left holding none, and pinned.
+ * Returns false on error, with the pages mapped back.
+ * The frame table lock must be held. It is released while the pages are
+ * written out, with VICTIM pinned and its I/O in progress (see
+ * vm_io_begin()), so that the table is only locked to pick the victim and to
+ * unlink its pages. */
+static bool
+vm_evict (struct frame *victim) {
+	struct page *page;
+	struct list_elem *e;
+	uint64_t *pml4;
+	bool pinned = victim->pinned, success = true, dirty;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+
+	/* Unmap the pages first, so that their owners cannot modify them while
+	 * they are being written out. */
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		page = list_entry (e, struct page, f_elem);
+		ASSERT (page->frame == victim
+				&& victim->kva == pml4_get_page (page->t->pml4, page->va));
+		pml4_clear_page (page->t->pml4, page->va);
+	}
+	victim->pinned = true;
+	vm_io_begin (victim);
+	lock_release (&frame_t.lock);
+	for (e = list_begin (&victim->pages);
+			success && e != list_end (&victim->pages); e = list_next (e))
+		success = swap_out (list_entry (e, struct page, f_elem));
+	lock_acquire (&frame_t.lock);
+	vm_io_end (victim);
+	if (!success) {
+		/* Map the pages back as they were, read-only if sharing the frame. */
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			page = list_entry (e, struct page, f_elem);
+			pml4 = page->t->pml4;
+			dirty = pml4_is_dirty (pml4, page->va);
+			ASSERT (pml4_set_page (pml4, page->va, victim->kva,
+					page->writable && victim->ref_cnt == 1));
+			pml4_set_dirty (pml4, page->va, dirty);
 		}
+		victim->pinned = pinned;
+		return false;
 	}
-	return NULL;
+	/* Remove all links between pages and frame. */
+	while (!list_empty (&victim->pages))
+		frame_unlink (victim, list_entry (list_front (&victim->pages),
+				struct page, f_elem));
+	ASSERT (!victim->page && victim->ref_cnt == 0);
+	return true;
+}
+
+/* Returns true if any page held by FRAME is locked in the main memory.
+ * The frame table lock must be held. */
+static bool
+vm_frame_locked (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (list_entry (e, struct page, f_elem)->locked)
+			return true;
+	return false;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is for a page of the current thread, which replaces one of its own
+ * pages instead if over its resident set limit or share (see vm_rss_over()).
+ * The returned frame is pinned, so that it cannot be chosen as a victim until
+ * its page has been completely swapped in. */
 static struct frame *
-vm_get_frame (void) {
-	struct frame *frame;
-	void *kva;
+vm_get_frame (bool zero) {
+	struct thread *t = thread_current ();
+	struct frame *frame = NULL;
+	bool own = false;
+	void *kva = NULL;
 
-	kva = palloc_get_page (PAL_USER);
-	if (!kva) {
-		frame = vm_evict_frame ();
-		if (!frame)
-			PANIC ("Could not evict a frame");
+	lock_acquire (&frame_t.lock);
+	if (vm_rss_over (t))
+		own = (frame = vm_evict_frame (t)) != NULL;
+	/* Frames to be zero filled are taken from the zeroed ones if possible. */
+	if (!frame && zero) {
+		if (frame_t.zeroed_cnt > 0) {
+			frame = frame_t.pool[--frame_t.zeroed_cnt];
+			frame_t.pool[frame_t.zeroed_cnt] = frame_t.pool[--frame_t.pool_cnt];
+			frame_t.free_cnt--;
+			vm_zero_hits++;
+		} else
+			vm_zero_misses++;
+	}
+	lock_release (&frame_t.lock);
+	if (!frame)
+		kva = palloc_get_page (PAL_USER);
+	lock_acquire (&frame_t.lock);
+	if (frame) {
+		ASSERT (own || frame->zeroed);
+	} else if (kva) {
+		frame = kva_to_frame (kva);
+		frame_t.free_cnt--;
+	} else if (frame_t.pool_cnt > 0) {
+		/* Take the pool's frames before evicting. */
+		frame = frame_t.pool[--frame_t.pool_cnt];
+		if (frame_t.zeroed_cnt > frame_t.pool_cnt)
+			frame_t.zeroed_cnt--;
+		frame_t.free_cnt--;
 	} else {
-		ASSERT (vm_is_page_addr (kva)); ///////////////////////////////////////////////Debugging purposes: May be incorrect
-		frame = (struct frame*)malloc (sizeof (struct frame));
-		if (!frame)
-			PANIC ("Insufficient space for a frame");
-		frame->kva = kva;
+		/* The frames being evicted by other threads are not victims, so wait
+		 * for them if there is nothing else to evict. */
+		while (!(frame = vm_evict_frame (NULL))) {
+			if (frame_t.io_cnt == 0)
+				PANIC ("Could not evict a frame");
+			cond_wait (&frame_t.io_done, &frame_t.lock);
+		}
+	}
+	ASSERT (!frame->page);
+	frame->pinned = true;
+	/* Wake up the writeback daemon on low memory. */
+	if (frame_t.free_cnt < vm_writeback_low && !frame_t.writeback_pending) {
+		frame_t.writeback_pending = true;
+		sema_up (&frame_t.writeback);
 	}
-	frame->page = NULL;
+	lock_release (&frame_t.lock);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Releases FRAME back to the user pool. It must not hold any page.
+ * The frame table lock must be held. */
+static void
+vm_free_frame (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (frame && kva_to_frame (frame->kva) == frame);
+	ASSERT (!frame->page && frame->ref_cnt == 0);
+
+	frame_t.free_cnt++;
+	frame->zeroed = false;
+	frame->referenced = false;
+	/* Keep the frame for the idle thread to zero it, if there is room. */
+	if (frame_t.pool_cnt < ZERO_POOL_PAGES) {
+		frame_t.pool[frame_t.pool_cnt++] = frame;
+		return;
+	}
+	frame->pinned = false;
+	palloc_free_page (frame->kva);
+}
+
+/* Zeroes a frame of the pool ahead of time. Called by the idle thread with
+ * interrupts on, so that it is preempted as soon as any other thread is
+ * ready, and never waits for the frame table lock. Returns false if there is
+ * nothing left to zero or the lock is busy. */
+bool
+vm_zero_idle (void) {
+	struct frame *frame;
+	bool done = false;
+
+	if (frame_t.zeroed_cnt == frame_t.pool_cnt
+			|| !lock_try_acquire (&frame_t.lock))
+		return false;
+	if (frame_t.zeroed_cnt < frame_t.pool_cnt) {
+		frame = frame_t.pool[frame_t.zeroed_cnt++];
+		fpu_page_zero (frame->kva);
+		frame->zeroed = true;
+		done = true;
+	}
+	lock_release (&frame_t.lock);
+	return done;
+}
+
+/* Unmaps PAGE and drops its reference to its frame, which is released once
+ * no other page shares it.
+ * The frame table lock must be held. */
+void
+vm_release_frame (struct page *page) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_t.lock));
+	ASSERT (page && page->frame);
+	frame = page->frame;
+	ASSERT (pml4_get_page (page->t->pml4, page->va) == frame->kva);
+
+	pml4_clear_page (page->t->pml4, page->va);
+	frame_unlink (frame, page);
+	if (frame->ref_cnt == 0)
+		vm_free_frame (frame);
+}
+
+/* Growing the stack. The new page is only given a frame if the fault is a
+ * WRITE, otherwise it is mapped to the zero frame. */
 static bool
-vm_stack_growth (void *addr) {
+vm_stack_growth (void *addr, bool write) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
 	addr = pg_round_down (addr);
 	ASSERT (addr);
 	return vm_alloc_page (VM_ANON | VM_ANON_STACK, addr, true)
-			&& vm_claim_page (addr, &thread_current ()->spt);
+			&& vm_claim_fault_page (spt, spt_find_page (spt, addr), write);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * PAGE is writable, but it is mapped read-only because its frame is shared
+ * (copy-on-write), so it gets a private copy of the frame. If it turns out to
+ * be the only page left in the frame, the frame is just made writable. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
-	ASSERT (0);///////////////////////////////////////////////////////////////////Not implemented
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = page->t->pml4;
+	struct frame *old, *new;
+
+	ASSERT (page->writable);
+
+	lock_acquire (&frame_t.lock);
+	vm_wait_io (page);
+	old = page->frame;
+	if (old && old->ref_cnt == 1) {
+		pml4_set_writable (pml4, page->va, true);
+		lock_release (&frame_t.lock);
+		return true;
+	}
+	lock_release (&frame_t.lock);
+	/* A demand-zero page mapped to the zero frame gets its own on its first
+	 * write. */
+	if (!old && vm_is_demand_zero (page))
+		return vm_do_claim_page (page);
+
+	new = vm_get_frame (false);
+	lock_acquire (&frame_t.lock);
+	/* Check again, the shared frame may have been evicted or left by the other
+	 * pages meanwhile. */
+	vm_wait_io (page);
+	old = page->frame;
+	if (!old || old->ref_cnt == 1) {
+		/* If evicted, the page is claimed back on the next (not present) fault. */
+		if (old)
+			pml4_set_writable (pml4, page->va, true);
+		vm_free_frame (new);
+		lock_release (&frame_t.lock);
+		return true;
+	}
+	fpu_page_copy (new->kva, old->kva);
+	pml4_clear_page (pml4, page->va);
+	frame_unlink (old, page);
+	frame_link (new, page);
+	ASSERT (pml4_set_page (pml4, page->va, new->kva, true));
+	new->pinned = false;
+	lock_release (&frame_t.lock);
+	return true;
 }
 
 /* Return true on success */
@@ -261,24 +1576,294 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user,
 						&& (page = spt_find_page (spt, pg_va))
 						&& page->operations->type == VM_ANON
 						&& page->anon.a_type == ANON_STACK)
-					return vm_stack_growth (addr);
+					return vm_stack_growth (addr, write);
 				///////////////////////////////////////////////////////////////////////////////
 				return false; //Unexisting non-stack page
 			}
 			if (write && !page->writable) {
 				return false; //Writing r/o page
 			}
-			return vm_do_claim_page (page);
-		} else
+			return vm_claim_fault_page (spt, page, write);
+		} else if (write && (page = spt_find_page (spt, pg_va)) && page->writable)
+			return vm_handle_wp (page); //Writing copy-on-write page
+		else
 			return false; //Writing r/o page
 	} else { //Kernel fault
 		//printf("vm_try_handle_fault: Kernel Fault\n");//////////////////////////////TEMPORAL
-		ASSERT (not_present);
-		//printf("vm_try_handle_fault: Not present fault\n");/////////////////////////TEMPORAL
 		page = spt_find_page (spt, pg_va);
 		ASSERT (page);
+		if (!not_present) //Writing a copy-on-write page on behalf of the user
+			return write && page->writable && vm_handle_wp (page);
+		//printf("vm_try_handle_fault: Not present fault\n");/////////////////////////TEMPORAL
+		return vm_claim_fault_page (spt, page, write);
+	}
+}
+
+/* Claims PAGE of SPT, which has just faulted, and, if it was swapped out,
+ * also swaps in the following pages whose swap slots come right after its
+ * own (read-ahead), so that a sequential scan does not fault on every page.
+ * The read-ahead window doubles, up to RA_MAX_PAGES, while faults hit the
+ * page right after the last window, and falls back to a single page
+ * otherwise. Read-ahead stops as soon as it would have to evict (see
+ * vm_has_spare_frame()).
+ * The pages of an area advised as random (see vm_madvise()) are never read
+ * ahead, and those of an area advised as sequential are read ahead as much as
+ * possible from the first fault.
+ * A demand-zero page faulted by a read is just mapped to the zero frame.
+ * A page being evicted is claimed once written out. */
+static bool
+vm_claim_fault_page (struct supplemental_page_table *spt, struct page *page,
+		bool write) {
+	struct page *next;
+	struct vma *vma;
+	size_t idx = SWAP_NONE, i;
+	void *va = page->va;
+	int advice;
+
+	if (!write && vm_is_demand_zero (page))
+		return pml4_set_page (page->t->pml4, va, frame_t.zero_kva, false);
+	if (page->operations->type == VM_LARGE)
+		return vm_do_claim_page (page);
+	lock_acquire (&frame_t.lock);
+	vm_wait_io (page);
+	lock_release (&frame_t.lock);
+	/* The eviction may have failed, leaving the page mapped. */
+	if (page->frame)
+		return true;
+	if (vm_text_claim (page))
+		return true;
+	vma = vma_find (&spt->vmas, va);
+	advice = (vma)? vma->advice: MADV_NORMAL;
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		idx = page->anon.idx;
+	else if (advice == MADV_SEQUENTIAL)
+		return vm_claim_file_around (spt, page, 2 * vm_fault_around);
+	else if (vm_fault_around > 1 && advice != MADV_RANDOM)
+		return vm_claim_file_around (spt, page, vm_fault_around);
+	if (!vm_do_claim_page (page))
+		return false;
+	if (idx == SWAP_NONE || advice == MADV_RANDOM)
+		return true;
+
+	if (advice == MADV_SEQUENTIAL)
+		spt->ra_window = RA_MAX_PAGES;
+	else if (va == spt->ra_next)
+		spt->ra_window = (2 * spt->ra_window < RA_MAX_PAGES)?
+				2 * spt->ra_window: RA_MAX_PAGES;
+	else
+		spt->ra_window = 1;
+	for (i = 1; i < spt->ra_window; i++) {
+		next = spt_lookup_page (spt, va + i * PGSIZE);
+		if (!next || next->frame || VM_TYPE (next->operations->type) != VM_ANON
+				|| next->anon.idx != idx + i
+				|| !vm_has_spare_frame ()
+				|| !vm_do_claim_page (next))
+			break;
+	}
+	spt->ra_next = va + i * PGSIZE;
+	return true;
+}
+
+/* Returns true if PAGE has not been loaded yet and its contents are all
+ * zeros: A stack page, or a page of an executable segment past its file
+ * contents. */
+static bool
+vm_is_demand_zero (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_UNINIT || page->frame)
+		return false;
+	if (page->uninit.type == (VM_ANON | VM_ANON_STACK))
+		return page->uninit.init == NULL;
+	return page->uninit.type == (VM_ANON | VM_ANON_EXEC)
+			&& ((struct load_segment_aux*)page->uninit.aux)->read_bytes == 0;
+}
+
+/* Returns true if loading PAGE zeroes part of its frame, which is then
+ * better taken from the zeroed ones. */
+static bool
+vm_is_zero_filled (struct page *page) {
+	struct file *file;
+	off_t ofs;
+	size_t length;
+
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (page->uninit.type == (VM_ANON | VM_ANON_STACK))
+				return true;
+			/* Fall through. */
+		case VM_FILE:
+			return vm_file_range (page, &file, &ofs, &length) && length < PGSIZE;
+		case VM_ANON:
+			return page->anon.idx == SWAP_NONE && page->anon.exec_clean
+					&& page->anon.exec_bytes < PGSIZE;
+		default:
+			return false;
+	}
+}
+
+/* Unmaps PAGE if it is mapped to the zero frame. */
+static void
+vm_unmap_zero (struct page *page) {
+	uint64_t *pml4 = page->t->pml4;
+
+	if (!page->frame && pml4
+			&& pml4_get_page (pml4, page->va) == frame_t.zero_kva)
+		pml4_clear_page (pml4, page->va);
+}
+
+/* Stores in *FILE, *OFS and *LENGTH the range of a file that PAGE, which must
+ * not be in the main memory, is loaded from: Either a file mapped page or a
+ * not yet loaded page of an executable segment. Returns false if PAGE is not
+ * loaded from a file. */
+static bool
+vm_file_range (struct page *page, struct file **file, off_t *ofs,
+		size_t *length) {
+	struct file_page *file_page;
+	struct load_segment_aux *aux;
+
+	ASSERT (!page->frame);
+
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (VM_TYPE (page->uninit.type) == VM_FILE) {
+				file_page = (struct file_page*)page->uninit.aux;
+				break;
+			}
+			if (page->uninit.type != (VM_ANON | VM_ANON_EXEC))
+				return false;
+			aux = (struct load_segment_aux*)page->uninit.aux;
+			*file = aux->file;
+			*ofs = aux->offset;
+			*length = aux->read_bytes;
+			return true;
+		case VM_FILE:
+			file_page = &page->file;
+			break;
+		default:
+			return false;
+	}
+	*file = file_page->file;
+	*ofs = file_page->offset;
+	*length = file_page->length;
+	return true;
+}
+
+/* Claims PAGE of SPT, which has just faulted, together with the following
+ * pages, up to MAX_CNT in all, that are loaded from the next bytes of the
+ * same file and are not in the main memory yet (fault-around). The contents
+ * of all of them are read by a single file_read_at() into a bounce buffer,
+ * which vm_file_read() then copies from as each page is loaded. Fault-around
+ * stops as soon as it would have to evict (see vm_has_spare_frame()). */
+static bool
+vm_claim_file_around (struct supplemental_page_table *spt, struct page *page,
+		size_t max_cnt) {
+	struct page *next;
+	struct file *file, *next_file;
+	off_t ofs, next_ofs;
+	size_t length, next_length, total, cnt, i;
+	bool success;
+
+	if (!vm_file_range (page, &file, &ofs, &length))
+		return vm_do_claim_page (page);
+
+	/* Find the pages whose contents follow PAGE's in the file. */
+	total = length;
+	for (cnt = 1; cnt < max_cnt && length == PGSIZE
+			&& frame_t.free_cnt > vm_writeback_low + cnt; cnt++) {
+		next = spt_find_page (spt, page->va + cnt * PGSIZE);
+		if (!next || next->frame
+				|| !vm_file_range (next, &next_file, &next_ofs, &next_length)
+				|| next_file != file || next_ofs != ofs + (off_t)total
+				|| next_length == 0)
+			break;
+		length = next_length;
+		total += length;
+	}
+	if (cnt == 1 || spt->fa_file
+			|| !(spt->fa_buf = palloc_get_multiple (0, DIV_ROUND_UP (total, PGSIZE))))
 		return vm_do_claim_page (page);
+
+	spt->fa_len = file_read_at (file, spt->fa_buf, total, ofs);
+	spt->fa_file = file;
+	spt->fa_ofs = ofs;
+	success = vm_do_claim_page (page);
+	for (i = 1; success && i < cnt; i++)
+		if (!vm_has_spare_frame ()
+				|| !vm_do_claim_page (spt_find_page (spt, page->va + i * PGSIZE)))
+			break;
+	palloc_free_multiple (spt->fa_buf, DIV_ROUND_UP (total, PGSIZE));
+	spt->fa_file = NULL;
+	spt->fa_buf = NULL;
+	return success;
+}
+
+/* Reads LENGTH bytes at offset OFS of FILE into KVA, the frame of a page being
+ * loaded, and returns the number of bytes read. If they have already been
+ * read by the current fault's fault-around, they are just copied. */
+off_t
+vm_file_read (struct file *file, void *kva, size_t length, off_t ofs) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	if (file == spt->fa_file && ofs >= spt->fa_ofs
+			&& (size_t)(ofs - spt->fa_ofs) + length <= spt->fa_len) {
+		memcpy (kva, spt->fa_buf + (ofs - spt->fa_ofs), length);
+		return length;
+	}
+	return file_read_at (file, kva, length, ofs);
+}
+
+/* Writes back the modified file mapped pages of SPT, the current thread's,
+ * in [START, END). Pages whose contents follow each other in their file are
+ * written together, up to WB_RUN_PAGES at a time, by a single write. Pages
+ * are left clean, so that destroying them needs no further I/O. The frame
+ * table lock is released during the writes (see vm_writeback_run()). */
+void
+vm_writeback_area (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	struct page *run[WB_RUN_PAGES], *page, *last;
+	size_t cnt = 0;
+	uint8_t *buf;
+	void *va;
+
+	ASSERT (spt == &thread_current ()->spt);
+
+	/* Without a buffer, the pages are written back one by one. */
+	buf = palloc_get_multiple (0, WB_RUN_PAGES);
+	lock_acquire (&frame_t.lock);
+	for (va = start; va < end; va += PGSIZE) {
+		page = spt_lookup_page (spt, va);
+		if (page && page->frame && page->frame->io) {
+			/* Flush the run first, as its pages could be evicted while
+			 * waiting. */
+			if (cnt > 0)
+				vm_writeback_run (run, cnt, buf);
+			cnt = 0;
+			vm_wait_io (page);
+		}
+		if (page && (VM_TYPE (page->operations->type) != VM_FILE || !page->frame
+				|| !pml4_is_dirty (page->t->pml4, page->va)))
+			page = NULL;
+		if (!buf) {
+			if (page)
+				vm_writeback_page (page);
+			continue;
+		}
+		if (cnt > 0) {
+			last = run[cnt - 1];
+			if (!page || cnt == WB_RUN_PAGES || last->file.length != PGSIZE
+					|| page->file.file != last->file.file
+					|| page->file.offset != last->file.offset + PGSIZE) {
+				vm_writeback_run (run, cnt, buf);
+				cnt = 0;
+			}
+		}
+		if (page)
+			run[cnt++] = page;
 	}
+	if (cnt > 0)
+		vm_writeback_run (run, cnt, buf);
+	lock_release (&frame_t.lock);
+	if (buf)
+		palloc_free_multiple (buf, WB_RUN_PAGES);
 }
 
 /* Free the page.
@@ -287,7 +1872,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user,
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	slab_free (&page_slab, page);
 }
 
 /* Claim the page that allocate on VA. */
@@ -301,7 +1886,12 @@ vm_claim_page (void *va, struct supplemental_page_table *spt) {
 	page = spt_find_page (spt, va);
 	if (!page) //The page does not exist
 		return false;
-	ASSERT (page->va == va);
+	ASSERT (page->va == va || page->operations->type == VM_LARGE);
+	lock_acquire (&frame_t.lock);
+	vm_wait_io (page);
+	lock_release (&frame_t.lock);
+	if (page->frame && page->operations->type != VM_LARGE)
+		return true;
 	//printf("vm_claim_page: calling vm_do_claim_page\n"); /////////////////////////TEMPORAL: TESTING
 	return vm_do_claim_page (page);
 }
@@ -309,142 +1899,421 @@ vm_claim_page (void *va, struct supplemental_page_table *spt) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
 	uint64_t *pml4;
+	struct inode *inode;
+	off_t ofs;
+	size_t bytes;
+	bool success, text;
 
 	ASSERT (page);
+	/* A large page keeps its frames, so it only needs to be mapped. */
+	if (page->operations->type == VM_LARGE)
+		return pml4_set_large_page (page->t->pml4, page->va, page->frame->kva,
+				page->writable);
+	/* A read-only page of an executable may already be in another process's
+	 * frame. Otherwise, the frame it is loaded into is shared from now on. */
+	text = vm_text_key (page, &inode, &ofs, &bytes);
+	if (text && vm_text_claim (page))
+		return true;
+	frame = vm_get_frame (vm_is_zero_filled (page));
 	ASSERT (thread_is_user (page->t));
 	ASSERT (vm_is_page_addr (page->va)); ////////////////////////////////////////////Debugging purposes: May be incorrect
 	pml4 = page->t->pml4;
+	vm_unmap_zero (page);
 	ASSERT (!pml4_get_page (pml4, page->va)); //Must NOT be mapped already ///////Use return instead of assert?
 
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	/* Set links. The frame is pinned, but linking also changes the owner's
+	 * resident set size and the text frames, which are shared. */
+	lock_acquire (&frame_t.lock);
+	frame_link (frame, page);
+	lock_release (&frame_t.lock);
 	/* Insert page table entry to map page's VA to frame's PA. */
 	if (pml4_set_page (pml4, page->va, frame->kva, page->writable)) {
 		/* Correct way of handling swap_in error?
 		(Assumption so far: The page is already well-mapped so it can be destroyed
 		with no issue by the caller). */
 		//printf("vm_do_claim_page: swapping in\n"); /////////////////////////////////TEMPORAL: TESTING
-		return swap_in (page, frame->kva);//////////////////////////////////////////May have issues
+		success = swap_in (page, frame->kva);//////////////////////////////////////May have issues
+		if (success && text) {
+			lock_acquire (&frame_t.lock);
+			vm_text_add (frame, inode, ofs, bytes);
+			lock_release (&frame_t.lock);
+		}
+		/* The frame may now be chosen as a victim. */
+		frame->zeroed = false;
+		frame->pinned = false;
+		return success;
 	}
-	palloc_free_page (frame->kva);
-	free (frame);
-	page->frame = NULL;
+	lock_acquire (&frame_t.lock);
+	frame_unlink (frame, page);
+	vm_free_frame (frame);
+	lock_release (&frame_t.lock);
 	printf("vm_do_claim_page: failure\n"); ///////////////////////////////////////TEMPORAL: TESTING
 	return false;
 }
 
-/* Hash function for a supplemental_page_table page holding a hash_elem E. */
-static uint64_t
-spt_hash_func (const struct hash_elem *e, void *spt_ UNUSED) {
+/* Returns true if every page of [START, END) of SPT either exists or lies in an
+ * area. */
+bool
+vm_range_is_mapped (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	struct vma *vma;
+	void *va = start;
+
+	while (va < end) {
+		if ((vma = vma_find (&spt->vmas, va)))
+			va = vma->end;
+		else if (spt_lookup_page (spt, va))
+			va += PGSIZE;
+		else
+			return false;
+	}
+	return true;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages of [START, END) of
+ * the current thread, which must be mapped:
+ * - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL set how much is read ahead
+ *   on a fault in the areas overlapping the range (see
+ *   vm_claim_fault_page()). As areas are never split, each of them takes the
+ *   advice as a whole.
+ * - MADV_WILLNEED loads the pages that are not in the main memory, as long as
+ *   there are free frames. It is only a hint, so a page that cannot be loaded
+ *   is left to be loaded on its first access.
+ * - MADV_DONTNEED evicts the pages in the main memory, unless locked, being
+ *   loaded or sharing their frame. Their contents are kept, so that they are
+ *   loaded back on the next access.
+ * Returns false if ADVICE is unknown. */
+bool
+vm_madvise (void *start, void *end, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
 	struct page *page;
+	struct frame *frame;
+	void *va;
 
-	ASSERT (e);
+	ASSERT (vm_range_is_mapped (spt, start, end));
 
-	page = hash_entry (e, struct page, h_elem);
-	ASSERT (vm_is_page_addr (page->va)); ////////////////////////////////////////////Debugging purposes: May be incorrect
-	return hash_bytes (&page->va, sizeof (page->va));
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			for (vma = vma_find_next (&spt->vmas, start); vma && vma->start < end;
+					vma = vma_find_next (&spt->vmas, vma->end))
+				vma->advice = advice;
+			return true;
+		case MADV_WILLNEED:
+			for (va = start; va < end
+					&& frame_t.free_cnt > vm_writeback_low; va += PGSIZE) {
+				page = spt_find_page (spt, va);
+				/* Best effort: Failures are not reported. */
+				if (page && !page->frame
+						&& pml4_get_page (page->t->pml4, va) == NULL)
+					vm_claim_fault_page (spt, page, false);
+			}
+			return true;
+		case MADV_DONTNEED:
+			lock_acquire (&frame_t.lock);
+			for (va = start; va < end; va += PGSIZE) {
+				page = spt_lookup_page (spt, va);
+				if (!page || page->operations->type == VM_LARGE)
+					continue;
+				frame = page->frame;
+				if (frame && frame->ref_cnt == 1 && !frame->pinned
+						&& !page->locked && vm_evict (frame))
+					vm_free_frame (frame);
+			}
+			lock_release (&frame_t.lock);
+			return true;
+		default:
+			return false;
+	}
 }
 
-/* Default function for comparison between two hash elements A and B that belong
- * to a supplemental_page_table entry (page).
- * Returns TRUE if A belongs to a page whose va value is less than B's. */
-static bool
-spt_less_func (const struct hash_elem *a, const struct hash_elem *b,
-		void *spt_ UNUSED) {
-	struct page *a_page, *b_page;
+/* Locks the pages of [START, END) of the current thread, which must be mapped,
+ * in the main memory, loading them if needed, or unlocks them if LOCK is
+ * false. Returns false if locking would take more than half of the user pool
+ * or if a page cannot be loaded, in which case the pages before it are left
+ * locked. */
+bool
+vm_mlock (void *start, void *end, bool lock) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
+	void *va;
 
-	ASSERT (a && b);
+	ASSERT (vm_range_is_mapped (spt, start, end));
 
-	a_page = hash_entry (a, struct page, h_elem);
-	b_page = hash_entry (b, struct page, h_elem);
-	ASSERT (vm_is_page_addr (a_page->va)); //////////////////////////////////////////Debugging purposes: May be incorrect
-	ASSERT (vm_is_page_addr (b_page->va)); //////////////////////////////////////////Debugging purposes: May be incorrect
-	return a_page->va < b_page->va;
+	for (va = start; va < end; va += PGSIZE) {
+		page = (lock)? spt_find_page (spt, va): spt_lookup_page (spt, va);
+		if (!page) {
+			if (lock)
+				return false;
+			continue;
+		}
+		lock_acquire (&frame_t.lock);
+		vm_wait_io (page);
+		if (page->locked != lock) {
+			if (lock && frame_t.locked_cnt >= frame_t.size / 2) {
+				lock_release (&frame_t.lock);
+				return false;
+			}
+			page->locked = lock;
+			frame_t.locked_cnt += (lock)? 1: -1;
+		}
+		lock_release (&frame_t.lock);
+		/* A page mapped to the zero frame gets its own, to be written. */
+		if (lock && !page->frame && !vm_do_claim_page (page))
+			return false;
+	}
+	return true;
 }
 
 /* Initialize new supplemental page table */
 bool
 supplemental_page_table_init (struct supplemental_page_table *spt) {
 	ASSERT (spt);
-	return hash_init (&spt->table, spt_hash_func, spt_less_func, spt);
+	spt->ra_next = NULL;
+	spt->ra_window = 1;
+	spt->fa_file = NULL;
+	spt->fa_buf = NULL;
+	spt->fa_ofs = 0;
+	spt->fa_len = 0;
+	vma_tree_init (&spt->vmas);
+	radix_init (&spt->pages);
+	return true;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst, which must be the current
+ * thread's.
+ * Anonymous pages are not copied but shared with SRC's (copy-on-write): The
+ * new pages take the frame or the swap slot of the original ones. */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src) {
-	struct hash_iterator it;
-	struct hash_elem *elem;
-	struct page *parent_pg;
-	enum vm_type type;
+	struct vma_tree vmas;
+	struct page *page;
+	uint64_t pg;
+	struct vma *vma, *copy;
+	bool success = true;
 
 	ASSERT (dst && src);
+	ASSERT (dst == &thread_current ()->spt);
 
-	/* Copy all pages. */
-	hash_first (&it, &src->table);
-	while ((elem = hash_next (&it))) {
-		parent_pg = hash_entry (elem, struct page, h_elem);
-		/* Get page type to be passed to initializer. */
-		switch (parent_pg->operations->type) {
-			case VM_UNINIT:
-				type = parent_pg->uninit.type;
-				break;
-			case VM_ANON:
-				switch (parent_pg->anon.a_type) {
-					case ANON_STACK:
-						type = VM_ANON | VM_ANON_STACK;
-						break;
-					case ANON_EXEC:
-						type = VM_ANON | VM_ANON_EXEC;
-						break;
-					default:
-						ASSERT (0);
-				}
-				break;
-			case VM_FILE:
-				type = VM_FILE;/////////////////////////////////////////////////////////May require more cases
-				break;
-			default:
-				ASSERT (0);
+	/* Copy all areas first, as the pages of file mappings borrow their
+	 * file from them. Executable segments are read from the child's own
+	 * executable. */
+	vma_tree_init (&vmas);
+	for (vma = vma_find_next (&src->vmas, NULL); vma && success;
+			vma = vma_find_next (&src->vmas, vma->end)) {
+		copy = (struct vma*)slab_alloc (&vm_vma_slab);
+		if (!copy)
+			success = false;
+		else {
+			*copy = *vma;
+			/* Inserted even without its file, so that it is torn down. */
+			if (copy->file && !(copy->file = file_dup2 (vma->file)))
+				success = false;
+			ASSERT (vma_insert (&vmas, copy));
 		}
-		/* Initialize and copy page. */
-		if (!(vm_alloc_page_with_initializer (type, parent_pg->va, parent_pg->writable,
-				page_copy, parent_pg) && vm_claim_page (parent_pg->va, dst)))
-			return false;
 	}
-	ASSERT (hash_size (&dst->table) == hash_size (&src->table));
+
+	/* Copy all pages, in address order. */
+	for (pg = 0; success && (page = radix_next (&src->pages, &pg)); pg++)
+		success = spt_copy_page (page, &vmas);
+
+	/* Only now install the areas, which would otherwise take the addresses of
+	 * the pages being copied. */
+	dst->vmas = vmas;
+	return success;
+}
+
+/* Creates a copy of PARENT_PG, which belongs to another process, in the
+ * current thread's spt, whose areas, not installed yet, are VMAS. */
+static bool
+spt_copy_page (struct page *parent_pg, struct vma_tree *vmas) {
+	struct vma *vma;
+	enum vm_type type;
+	bool success;
+
+	switch (VM_TYPE (parent_pg->operations->type)) {
+		case VM_UNINIT:
+			type = parent_pg->uninit.type;
+			switch (VM_TYPE (type)) {
+				case VM_ANON:
+					if (VM_SUBTYPE (type) == VM_ANON_STACK)
+						return vm_alloc_page (type, parent_pg->va, parent_pg->writable);
+					ASSERT (VM_SUBTYPE (type) == VM_ANON_EXEC);
+					return spt_copy_seg_page (parent_pg);
+				case VM_FILE:
+					break;
+				default:
+					ASSERT (0);
+			}
+			/* Fall through. */
+		case VM_FILE:
+			lock_acquire (&frame_t.lock);
+			/* The new page reads the parent's contents from the file, so write
+			 * them back first, without the lock meanwhile. */
+			vm_wait_io (parent_pg);
+			if (VM_TYPE (parent_pg->operations->type) == VM_FILE
+					&& parent_pg->frame)
+				vm_writeback_page (parent_pg);
+			/* The new page borrows the file of the current thread's copy of
+			 * the area, which outlives the parent's. */
+			vma = vma_find (vmas, parent_pg->va);
+			ASSERT (vma && vma->type == VM_FILE && vma->file);
+			success = file_map_copy (parent_pg, vma->file);
+			lock_release (&frame_t.lock);
+			return success;
+		case VM_ANON:
+			return spt_share_anon_page (parent_pg);
+		case VM_LARGE:
+			return spt_copy_large_page (parent_pg);
+		default:
+			ASSERT (0);
+	}
+	NOT_REACHED ();
+}
+
+/* Creates in the current thread's spt a copy of PARENT_PG, a page of an
+ * executable segment not loaded yet. The new page is not loaded either, but
+ * on its first access, from the same range of the current thread's own
+ * executable, so that its frame is charged to the current thread. */
+static bool
+spt_copy_seg_page (struct page *parent_pg) {
+	struct load_segment_aux *src, *aux;
+
+	ASSERT (VM_TYPE (parent_pg->operations->type) == VM_UNINIT);
+	ASSERT (parent_pg->uninit.type == (VM_ANON | VM_ANON_EXEC));
+	src = (struct load_segment_aux*)parent_pg->uninit.aux;
+	ASSERT (src && src->file == parent_pg->t->executable);
+
+	aux = (struct load_segment_aux*)slab_alloc (&vm_seg_aux_slab);
+	if (!aux)
+		return false;
+	aux->file = thread_current ()->executable;
+	aux->offset = src->offset;
+	aux->read_bytes = src->read_bytes;
+	if (!vm_alloc_page_with_initializer (parent_pg->uninit.type, parent_pg->va,
+			parent_pg->writable, parent_pg->uninit.init, aux)) {
+		slab_free (&vm_seg_aux_slab, aux);
+		return false;
+	}
 	return true;
 }
 
-/* Copies the information and data of the PARENT_PG page into the CHILD_PG page,
- * which must be mapped in its thread's pml4. */
+/* Creates in the current thread's spt a copy of PARENT_PG, a large page.
+ * A read-only large page holds just what its area is loaded with, so it is
+ * not copied but loaded again from the area when accessed. Otherwise, if no
+ * large page is available, its contents are copied into plain anonymous
+ * pages. */
 static bool
-page_copy (struct page *child_pg, void *parent_pg_) {
-	struct page *parent_pg = (struct page *)parent_pg_;
-	void *child_kva, *parent_kva;
-
-	ASSERT (child_pg && child_pg->frame && child_pg->frame->page == child_pg);
-	ASSERT (parent_pg);
-	ASSERT (child_pg->va == parent_pg->va);
-	ASSERT (thread_is_user (child_pg->t) && thread_is_user (parent_pg->t));
-	child_kva = child_pg->frame->kva;
-	ASSERT (pml4_get_page (child_pg->t->pml4, child_pg->va) == child_kva);
-
-	if (pml4_get_page (parent_pg->t->pml4, parent_pg->va)
-			|| vm_claim_page (parent_pg->va, &parent_pg->t->spt)) {
-		/* Both pages are now in the main memory. */
-		ASSERT (child_pg->operations == parent_pg->operations);
-		ASSERT (parent_pg->frame && parent_pg->frame->page == parent_pg);
-		parent_kva = parent_pg->frame->kva;
-		ASSERT (pml4_get_page (parent_pg->t->pml4, parent_pg->va) == parent_kva);
-		ASSERT (child_kva != parent_kva);
-		memcpy (child_kva, parent_kva, PGSIZE);
+spt_copy_large_page (struct page *parent_pg) {
+	struct frame *frame;
+	uint8_t *kva;
+	void *va;
+
+	ASSERT (parent_pg->operations->type == VM_LARGE && parent_pg->frame);
+
+	if (!parent_pg->writable)
 		return true;
+	if ((frame = vm_get_large_frame ())) {
+		memcpy (frame->kva, parent_pg->frame->kva, LPGSIZE);
+		if (vm_new_large_page (parent_pg->va, true, frame))
+			return true;
+		lock_acquire (&frame_t.lock);
+		vm_free_large_frame (frame);
+		lock_release (&frame_t.lock);
+		return false;
 	}
-	return false;
+	/* A large page keeps its frames for as long as it exists, and the parent
+	 * is blocked in fork() meanwhile, so they are read without the frame table
+	 * lock. */
+	kva = parent_pg->frame->kva;
+	for (va = parent_pg->va; va < parent_pg->va + LPGSIZE;
+			va += PGSIZE, kva += PGSIZE)
+		if (!spt_copy_to_anon_page (va, kva))
+			return false;
+	return true;
+}
+
+/* Creates in the current thread's spt a plain anonymous page at VA, loaded
+ * into a frame of its own with a copy of the page at KVA. */
+static bool
+spt_copy_to_anon_page (void *va, const void *kva) {
+	struct page *page;
+	struct frame *frame;
+	bool success;
+
+	if (!vm_alloc_page (VM_ANON, va, true))
+		return false;
+	page = spt_find_page (&thread_current ()->spt, va);
+	ASSERT (page);
+
+	frame = vm_get_frame (false);
+	fpu_page_copy (frame->kva, kva);
+	lock_acquire (&frame_t.lock);
+	frame_link (frame, page);
+	success = pml4_set_page (page->t->pml4, va, frame->kva, true);
+	if (!success) {
+		frame_unlink (frame, page);
+		vm_free_frame (frame);
+	}
+	lock_release (&frame_t.lock);
+	if (!success)
+		return false;
+	/* Initialize the page as its first fault would. */
+	success = swap_in (page, frame->kva);
+	frame->zeroed = false;
+	frame->pinned = false;
+	return success;
+}
+
+/* Creates in the current thread's spt an anonymous page that shares the
+ * frame, or the swap slot, of the anonymous page PARENT_PG. If they share a
+ * frame, both pages get mapped read-only until they are written. */
+static bool
+spt_share_anon_page (struct page *parent_pg) {
+	struct page *child_pg;
+	struct frame *frame;
+	enum vm_type type;
+	bool success = true;
+
+	ASSERT (VM_TYPE (parent_pg->operations->type) == VM_ANON);
+	switch (parent_pg->anon.a_type) {
+		case ANON_STACK:
+			type = VM_ANON | VM_ANON_STACK;
+			break;
+		case ANON_EXEC:
+			type = VM_ANON | VM_ANON_EXEC;
+			break;
+		case ANON_PLAIN:
+			type = VM_ANON;
+			break;
+		default:
+			ASSERT (0);
+	}
+	if (!vm_alloc_page (type, parent_pg->va, parent_pg->writable))
+		return false;
+	child_pg = spt_find_page (&thread_current ()->spt, parent_pg->va);
+	ASSERT (child_pg);
+
+	lock_acquire (&frame_t.lock);
+	vm_wait_io (parent_pg);
+	anon_share (child_pg, parent_pg);
+	frame = parent_pg->frame;
+	if (frame) {
+		frame_link (frame, child_pg);
+		if (pml4_set_page (child_pg->t->pml4, child_pg->va, frame->kva, false))
+			pml4_set_writable (parent_pg->t->pml4, parent_pg->va, false);
+		else {
+			frame_unlink (frame, child_pg);
+			success = false;
+		}
+	}
+	lock_release (&frame_t.lock);
+	return success;
 }
 
 /* Free the resource held by the supplemental page table.
@@ -452,30 +2321,61 @@ page_copy (struct page *child_pg, void *parent_pg_) {
  * process completely (i.e. by process_exit ()), or in order to change its
  * execution context (i.e. process_exec ()). */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt, bool exit) {
+supplemental_page_table_kill (struct supplemental_page_table *spt,
+		bool exit UNUSED) {
+	struct vma_tree vmas;
+	struct vma *vma;
+
 	ASSERT (spt);
+	/* Take the areas out first, so that destroying the pages does not create
+	 * them again, but destroy them last, as file mapped pages borrow their
+	 * file from them. */
+	vmas = spt->vmas;
+	vma_tree_init (&spt->vmas);
 	/* Destroy all the supplemental_page_table held by thread. */
-	if (spt->table.buckets) { //I.e. make sure there was no error on hash_init()
-		if (exit)
-			hash_destroy (&spt->table, spt_page_destructor);
-		else
-			hash_clear (&spt->table, spt_page_destructor);
-	} else
-		ASSERT (exit); //Error in hash_init() so the process must be terminating
+	for (vma = vma_find_next (&vmas, NULL); vma;
+			vma = vma_find_next (&vmas, vma->end))
+		if (vma->type == VM_FILE)
+			vm_writeback_area (spt, vma->start, vma->end);
+	/* Either way the table is left empty, and may be used again by
+	 * process_exec (). */
+	radix_destroy (&spt->pages, spt_page_destructor, spt);
+	vma_tree_destroy (&vmas, spt_vma_destructor);
 }
 
-/* Default destructor for a page holding a h_elem E. */
+/* Default destructor for a page PAGE_ of SPT_. */
 static void
-spt_page_destructor (struct hash_elem *e, void *spt_) {
-	struct page *page;
+spt_page_destructor (void *page_, void *spt_) {
+	struct page *page = (struct page*)page_;
 	struct supplemental_page_table *spt = (struct supplemental_page_table*)spt_;
 
-	ASSERT (e);
+	ASSERT (page);
 	ASSERT (spt);
 
-	page = hash_entry (e, struct page, h_elem);
-	if (hash_find (&spt->table, &page->h_elem)) { //Page not yet removed from spt
-		ASSERT (hash_delete (&spt->table, &page->h_elem) == &page->h_elem);
+	if (radix_lookup (&spt->pages, pg_no (page->va)) == page) { //Page not yet removed from spt
+		ASSERT (radix_remove (&spt->pages, pg_no (page->va)) == page);
 	}
+	/* Do not let the page's frame be evicted while it is being destroyed. If
+	 * it is being written out, wait for it, and write back a modified file
+	 * mapped page beforehand, so that destroying it needs no I/O under the
+	 * lock. */
+	lock_acquire (&frame_t.lock);
+	vm_wait_io (page);
+	if (VM_TYPE (page->operations->type) == VM_FILE && page->frame)
+		vm_writeback_page (page);
+	/* Drop what the destroy handlers do not know about: The page's lock in the
+	 * main memory, and its mapping to the zero frame. */
+	if (page->locked)
+		frame_t.locked_cnt--;
+	vm_unmap_zero (page);
 	vm_dealloc_page (page);
+	lock_release (&frame_t.lock);
+}
+
+/* Destructor for the areas of a supplemental page table. */
+static void
+spt_vma_destructor (struct vma *vma) {
+	if (vma->file)
+		file_close (vma->file);
+	slab_free (&vm_vma_slab, vma);
 }
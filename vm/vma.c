@@ -0,0 +1,190 @@
+/* vma.c: Virtual memory areas of an address space.
+ *
+ * The areas are kept in an AVL tree ordered by their start address. As the
+ * areas never overlap, this is also the order of their end addresses, so the
+ * area holding an address is found by a single descent of the tree. */
+
+#include "vm/vm.h"
+#include "vm/vma.h"
+#include <debug.h>
+
+static int
+height (const struct vma *n) {
+	return n != NULL ? n->height : 0;
+}
+
+static void
+update_height (struct vma *n) {
+	int l = height (n->left), r = height (n->right);
+	n->height = (l > r ? l : r) + 1;
+}
+
+static struct vma *
+rotate_right (struct vma *n) {
+	struct vma *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	update_height (n);
+	update_height (l);
+	return l;
+}
+
+static struct vma *
+rotate_left (struct vma *n) {
+	struct vma *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	update_height (n);
+	update_height (r);
+	return r;
+}
+
+/* Restores the balance of subtree N, whose children are balanced and differ
+ * in height by at most 2. Returns the new root of the subtree. */
+static struct vma *
+rebalance (struct vma *n) {
+	int balance;
+
+	update_height (n);
+	balance = height (n->left) - height (n->right);
+	if (balance > 1) {
+		if (height (n->left->left) < height (n->left->right))
+			n->left = rotate_left (n->left);
+		return rotate_right (n);
+	}
+	if (balance < -1) {
+		if (height (n->right->right) < height (n->right->left))
+			n->right = rotate_right (n->right);
+		return rotate_left (n);
+	}
+	return n;
+}
+
+static struct vma *
+insert_vma (struct vma *n, struct vma *vma) {
+	if (n == NULL)
+		return vma;
+	if (vma->start < n->start)
+		n->left = insert_vma (n->left, vma);
+	else
+		n->right = insert_vma (n->right, vma);
+	return rebalance (n);
+}
+
+/* Unlinks the leftmost area of subtree N into *MIN. */
+static struct vma *
+remove_min (struct vma *n, struct vma **min) {
+	if (n->left == NULL) {
+		*min = n;
+		return n->right;
+	}
+	n->left = remove_min (n->left, min);
+	return rebalance (n);
+}
+
+static struct vma *
+remove_vma (struct vma *n, struct vma *vma) {
+	struct vma *min;
+
+	ASSERT (n != NULL);
+	if (vma->start < n->start)
+		n->left = remove_vma (n->left, vma);
+	else if (vma->start > n->start)
+		n->right = remove_vma (n->right, vma);
+	else {
+		ASSERT (n == vma);
+		if (n->right == NULL)
+			return n->left;
+		n->right = remove_min (n->right, &min);
+		min->left = n->left;
+		min->right = n->right;
+		n = min;
+	}
+	return rebalance (n);
+}
+
+static void
+destroy_tree (struct vma *n, vma_action_func *destructor) {
+	if (n == NULL)
+		return;
+	destroy_tree (n->left, destructor);
+	destroy_tree (n->right, destructor);
+	if (destructor != NULL)
+		destructor (n);
+}
+
+/* Initializes TREE as empty. */
+void
+vma_tree_init (struct vma_tree *tree) {
+	tree->root = NULL;
+	tree->cnt = 0;
+}
+
+/* Removes all the areas of TREE, passing each of them to DESTRUCTOR if it
+ * is non-null. TREE is left empty. */
+void
+vma_tree_destroy (struct vma_tree *tree, vma_action_func *destructor) {
+	struct vma *root = tree->root;
+
+	vma_tree_init (tree);
+	destroy_tree (root, destructor);
+}
+
+/* Inserts VMA into TREE. Fails if VMA overlaps an area of TREE. */
+bool
+vma_insert (struct vma_tree *tree, struct vma *vma) {
+	ASSERT (vma->start < vma->end);
+
+	if (vma_overlaps (tree, vma->start, vma->end))
+		return false;
+	vma->left = vma->right = NULL;
+	vma->height = 1;
+	tree->root = insert_vma (tree->root, vma);
+	tree->cnt++;
+	return true;
+}
+
+/* Removes VMA, which must be in TREE. */
+void
+vma_remove (struct vma_tree *tree, struct vma *vma) {
+	ASSERT (tree->cnt > 0);
+
+	tree->root = remove_vma (tree->root, vma);
+	tree->cnt--;
+}
+
+/* Returns the area of TREE holding VA, or a null pointer if none does. */
+struct vma *
+vma_find (const struct vma_tree *tree, const void *va) {
+	struct vma *vma = vma_find_next (tree, va);
+
+	return vma != NULL && vma->start <= va ? vma : NULL;
+}
+
+/* Returns the first area of TREE ending after VA, which is the one holding
+ * VA if any, or a null pointer if there is none. Iterating from a null VA
+ * and then from the end of each area returned visits TREE in order. */
+struct vma *
+vma_find_next (const struct vma_tree *tree, const void *va) {
+	struct vma *n = tree->root, *next = NULL;
+
+	while (n != NULL) {
+		if (va < n->end) {
+			next = n;
+			n = n->left;
+		} else
+			n = n->right;
+	}
+	return next;
+}
+
+/* Returns true if an area of TREE overlaps [START, END). */
+bool
+vma_overlaps (const struct vma_tree *tree, const void *start,
+		const void *end) {
+	struct vma *vma = vma_find_next (tree, start);
+
+	return vma != NULL && vma->start < end;
+}
@@ -0,0 +1,299 @@
+/* zswap.c: Compressed in-memory cache of the swap disk.
+ *
+ * Pages written to a swap slot are first offered to the cache, which keeps
+ * them compressed in an arena of the kernel pool, so that swapping them in
+ * again takes no disk I/O. A page whose words all have the same value (most
+ * often zero) takes no room at all; any other page is compressed with a
+ * simple LZ77 scheme. Pages are only written to the swap disk if they do not
+ * compress well enough, or if the arena is full.
+ *
+ * The cache is indexed by swap slot: A page in the cache still holds its
+ * slot, whose contents on the disk are then stale, so that the sharing of
+ * slots between pages after fork() and the read-ahead of contiguous slots
+ * work the same whether a page is in the cache or on the disk.
+ *
+ * Like the swap table, the cache is protected by the swap table lock. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Arena allocation unit, in bytes. */
+#define ZSWAP_CHUNK 64
+
+/* Largest compressed size kept, in bytes. Pages that compress worse are left
+ * to the swap disk. */
+#define ZSWAP_MAX_LEN (PGSIZE * 3 / 4)
+
+/* LZ77 format: Groups of up to 8 items, each preceded by a control byte whose
+ * bit I tells whether item I is a match (2 bytes: 4 bits of length - LZ_MIN,
+ * 12 bits of distance back) or a literal byte. */
+#define LZ_MIN 3                        /* Shortest match. */
+#define LZ_MAX (LZ_MIN + 15)            /* Longest match. */
+#define LZ_HASH_BITS 12                 /* Bits of the match finder's hash. */
+#define LZ_NONE UINT16_MAX              /* Empty hash table entry. */
+
+/* State of a swap slot in the cache. */
+enum zswap_state {
+	ZSWAP_NONE,         /* Not in the cache. */
+	ZSWAP_SAME,         /* Page filled with VALUE. */
+	ZSWAP_STORED,       /* Compressed in the arena. */
+};
+
+struct zswap_entry {
+	uint64_t value;     /* ZSWAP_SAME: Value of each word of the page. */
+	uint32_t chunk;     /* ZSWAP_STORED: First chunk in the arena. */
+	uint16_t len;       /* ZSWAP_STORED: Compressed size in bytes. */
+	uint8_t state;      /* An enum zswap_state. */
+};
+
+/* Maximum number of pages of the arena, set by the -zs kernel option. By
+ * default, an eighth of the size of the user pool. */
+size_t vm_zswap_max = SIZE_MAX;
+
+static struct zswap {
+	struct zswap_entry *entries;  /* One per swap slot. */
+	size_t slot_cnt;              /* Number of ENTRIES. */
+	uint8_t *arena;               /* Compressed pages. */
+	struct bitmap *chunks;        /* Used chunks of ARENA. */
+	size_t chunk_cnt;             /* Number of chunks of ARENA. */
+	size_t hint;                  /* Chunk to start looking for room from. */
+	uint16_t hash[1 << LZ_HASH_BITS];  /* Match finder's positions. */
+	uint8_t buf[PGSIZE];          /* Compression output. */
+
+	/* Statistics. */
+	long long stored;             /* Pages compressed into the arena. */
+	long long same;               /* Same-filled pages. */
+	long long rejected;           /* Pages that did not compress enough. */
+	long long full;               /* Pages that did not fit in the arena. */
+	long long hits;               /* Pages loaded from the cache. */
+	long long misses;             /* Pages to be read from the disk. */
+	long long in_bytes;           /* Bytes of the pages compressed... */
+	long long out_bytes;          /* ...and of their compressed contents. */
+} zswap;
+
+/* Returns the hash of the 3 bytes at P. */
+static inline unsigned
+lz_hash (const uint8_t *p) {
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the page at SRC into DST. Returns the compressed size, or 0 if it
+ * would exceed LIMIT bytes. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t limit) {
+	size_t in = 0, out = 0, ctrl = 0, len, max, cand;
+	unsigned bit = 8, h;
+
+	memset (zswap.hash, 0xff, sizeof zswap.hash);
+	while (in < PGSIZE) {
+		if (bit == 8) {
+			/* Start a group, if all of it fits. */
+			if (out + 1 + 8 * 2 > limit)
+				return 0;
+			ctrl = out++;
+			dst[ctrl] = 0;
+			bit = 0;
+		}
+		len = 0;
+		if (in + LZ_MIN <= PGSIZE) {
+			h = lz_hash (src + in);
+			cand = zswap.hash[h];
+			zswap.hash[h] = in;
+			if (cand != LZ_NONE) {
+				max = (PGSIZE - in < LZ_MAX)? PGSIZE - in: LZ_MAX;
+				while (len < max && src[cand + len] == src[in + len])
+					len++;
+			}
+		}
+		if (len >= LZ_MIN) {
+			ASSERT (in - cand < PGSIZE);
+			dst[ctrl] |= 1 << bit;
+			dst[out++] = ((len - LZ_MIN) << 4) | ((in - cand) >> 8);
+			dst[out++] = (in - cand) & 0xff;
+			in += len;
+		} else
+			dst[out++] = src[in++];
+		bit++;
+	}
+	return out;
+}
+
+/* Decompresses the LEN bytes at SRC, produced by lz_compress(), into the page
+ * at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst) {
+	size_t in = 0, out = 0, n, dist;
+	unsigned bit = 8, ctrl = 0;
+
+	while (out < PGSIZE) {
+		if (bit == 8) {
+			ASSERT (in < len);
+			ctrl = src[in++];
+			bit = 0;
+		}
+		if (ctrl & (1 << bit)) {
+			n = (src[in] >> 4) + LZ_MIN;
+			dist = ((src[in] & 0xf) << 8) | src[in + 1];
+			in += 2;
+			ASSERT (dist > 0 && dist <= out && out + n <= PGSIZE);
+			/* Byte by byte, as the match may overlap its copy. */
+			for (; n > 0; n--, out++)
+				dst[out] = dst[out - dist];
+		} else
+			dst[out++] = src[in++];
+		bit++;
+	}
+	ASSERT (in == len);
+}
+
+/* Returns true if all words of the page at KVA are equal, storing their value
+ * in *VALUE. */
+static bool
+page_same_filled (const void *kva, uint64_t *value) {
+	const uint64_t *w = kva;
+
+	for (size_t i = 1; i < PGSIZE / sizeof *w; i++)
+		if (w[i] != w[0])
+			return false;
+	*value = w[0];
+	return true;
+}
+
+/* Takes CNT contiguous chunks of the arena and returns the first one, or
+ * BITMAP_ERROR if there is no room. Looks from the chunk after the last taken
+ * first, as chunks are mostly freed in the order they are taken. */
+static size_t
+chunks_alloc (size_t cnt) {
+	size_t chunk;
+
+	chunk = bitmap_scan_and_flip (zswap.chunks, zswap.hint, cnt, false);
+	if (chunk == BITMAP_ERROR && zswap.hint > 0)
+		chunk = bitmap_scan_and_flip (zswap.chunks, 0, cnt, false);
+	if (chunk != BITMAP_ERROR)
+		zswap.hint = (chunk + cnt < zswap.chunk_cnt)? chunk + cnt: 0;
+	return chunk;
+}
+
+/* Sets up the cache for a swap disk of SLOT_CNT slots, with an arena of up to
+ * vm_zswap_max pages. The arena is made smaller if the kernel pool cannot
+ * spare that much. */
+void
+zswap_init (size_t slot_cnt) {
+	size_t pages;
+
+	if (vm_zswap_max == SIZE_MAX) {
+		palloc_user_pool (&pages);
+		vm_zswap_max = pages / 8;
+	}
+	zswap.entries = calloc (slot_cnt, sizeof *zswap.entries);
+	if (!zswap.entries)
+		PANIC ("Unable to create the zswap table");
+	zswap.slot_cnt = slot_cnt;
+	for (pages = vm_zswap_max; pages > 0; pages /= 2)
+		if ((zswap.arena = palloc_get_multiple (0, pages)))
+			break;
+	zswap.chunk_cnt = pages * (PGSIZE / ZSWAP_CHUNK);
+	if (pages > 0 && !(zswap.chunks = bitmap_create (zswap.chunk_cnt)))
+		PANIC ("Unable to create the zswap arena");
+	vm_zswap_max = pages;
+	zswap.hint = 0;
+}
+
+/* Offers the page at KVA, about to be written to the swap slot IDX, to the
+ * cache, which replaces the previous contents of the slot. Returns true if it
+ * has been kept, false if it must be written to the swap disk. */
+bool
+zswap_store (size_t idx, const void *kva) {
+	struct zswap_entry *e;
+	size_t len, chunk;
+
+	ASSERT (idx < zswap.slot_cnt);
+
+	zswap_invalidate (idx);
+	e = &zswap.entries[idx];
+	if (page_same_filled (kva, &e->value)) {
+		e->state = ZSWAP_SAME;
+		zswap.same++;
+		return true;
+	}
+	if (zswap.chunk_cnt == 0)
+		return false;
+	len = lz_compress (kva, zswap.buf, ZSWAP_MAX_LEN);
+	if (len == 0) {
+		zswap.rejected++;
+		return false;
+	}
+	chunk = chunks_alloc (DIV_ROUND_UP (len, ZSWAP_CHUNK));
+	if (chunk == BITMAP_ERROR) {
+		zswap.full++;
+		return false;
+	}
+	memcpy (zswap.arena + chunk * ZSWAP_CHUNK, zswap.buf, len);
+	e->chunk = chunk;
+	e->len = len;
+	e->state = ZSWAP_STORED;
+	zswap.stored++;
+	zswap.in_bytes += PGSIZE;
+	zswap.out_bytes += len;
+	return true;
+}
+
+/* Loads the contents of the swap slot IDX into the page at KVA, if they are
+ * in the cache, where they stay until the slot is invalidated. Returns false
+ * if they must be read from the swap disk. */
+bool
+zswap_load (size_t idx, void *kva) {
+	struct zswap_entry *e;
+	uint64_t *w = kva;
+
+	ASSERT (idx < zswap.slot_cnt);
+
+	e = &zswap.entries[idx];
+	switch (e->state) {
+		case ZSWAP_SAME:
+			for (size_t i = 0; i < PGSIZE / sizeof *w; i++)
+				w[i] = e->value;
+			break;
+		case ZSWAP_STORED:
+			lz_decompress (zswap.arena + e->chunk * ZSWAP_CHUNK, e->len, kva);
+			break;
+		default:
+			zswap.misses++;
+			return false;
+	}
+	zswap.hits++;
+	return true;
+}
+
+/* Drops the contents of the swap slot IDX from the cache, if there. */
+void
+zswap_invalidate (size_t idx) {
+	struct zswap_entry *e;
+
+	ASSERT (idx < zswap.slot_cnt);
+
+	e = &zswap.entries[idx];
+	if (e->state == ZSWAP_STORED)
+		bitmap_set_multiple (zswap.chunks, e->chunk,
+				DIV_ROUND_UP (e->len, ZSWAP_CHUNK), false);
+	e->state = ZSWAP_NONE;
+}
+
+/* Prints the statistics of the cache. */
+void
+zswap_print_stats (void) {
+	printf ("Zswap: %lld compressed to %lld%%, %lld same-filled, "
+			"%lld incompressible, %lld full, %lld hits, %lld misses\n",
+			zswap.stored,
+			zswap.in_bytes? zswap.out_bytes * 100 / zswap.in_bytes: 0,
+			zswap.same, zswap.rejected, zswap.full, zswap.hits, zswap.misses);
+}